@@ -0,0 +1,45 @@
+#include "AlignedBufferPool.hpp"
+#include <bit>
+#include <new>
+#include <stdexcept>
+
+namespace vmgs {
+    AlignedBufferPool::AlignedBufferPool(size_t buffer_size, size_t alignment, size_t max_idle_buffers)
+        : m_buffer_size{ buffer_size }, m_alignment{ alignment }, m_max_idle_buffers{ max_idle_buffers }
+    {
+        if (!std::has_single_bit(alignment)) {
+            throw std::invalid_argument("Alignment must be a power of 2.");
+        }
+    }
+
+    AlignedBufferPool::~AlignedBufferPool() noexcept {
+        for (auto ptr : m_idle_buffers) {
+            ::operator delete[](ptr, std::align_val_t{ m_alignment });
+        }
+    }
+
+    void AlignedBufferPool::release(std::byte* ptr) noexcept {
+        {
+            std::lock_guard lock{ m_mutex };
+            if (m_idle_buffers.size() < m_max_idle_buffers) {
+                m_idle_buffers.push_back(ptr);
+                return;
+            }
+        }
+
+        ::operator delete[](ptr, std::align_val_t{ m_alignment });
+    }
+
+    AlignedBufferPool::Lease AlignedBufferPool::acquire() {
+        {
+            std::lock_guard lock{ m_mutex };
+            if (!m_idle_buffers.empty()) {
+                auto ptr = m_idle_buffers.back();
+                m_idle_buffers.pop_back();
+                return Lease{ this, ptr };
+            }
+        }
+
+        return Lease{ this, static_cast<std::byte*>(::operator new[](m_buffer_size, std::align_val_t{ m_alignment })) };
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace vmgs {
+    // A thread-safe pool of equally sized, aligned buffers.
+    // Released buffers are kept for reuse, up to `max_idle_buffers` of them.
+    class AlignedBufferPool {
+    public:
+        class Lease {
+            friend class AlignedBufferPool;
+        private:
+            AlignedBufferPool* m_pool;
+            std::byte* m_ptr;
+
+            Lease(AlignedBufferPool* pool, std::byte* ptr) noexcept
+                : m_pool{ pool }, m_ptr{ ptr } {}
+
+        public:
+            Lease(Lease&& other) noexcept
+                : m_pool{ std::exchange(other.m_pool, nullptr) }, m_ptr{ std::exchange(other.m_ptr, nullptr) } {}
+
+            Lease(const Lease& other) = delete;
+
+            ~Lease() noexcept {
+                if (m_pool) {
+                    m_pool->release(m_ptr);
+                }
+            }
+
+            Lease& operator=(Lease&& other) = delete;
+
+            Lease& operator=(const Lease& other) = delete;
+
+            [[nodiscard]]
+            std::byte* get() const noexcept {
+                return m_ptr;
+            }
+        };
+
+    private:
+        size_t m_buffer_size;
+        size_t m_alignment;
+        size_t m_max_idle_buffers;
+
+        std::mutex m_mutex;
+        std::vector<std::byte*> m_idle_buffers;
+
+        void release(std::byte* ptr) noexcept;
+
+    public:
+        AlignedBufferPool(size_t buffer_size, size_t alignment, size_t max_idle_buffers = 8);
+
+        AlignedBufferPool(const AlignedBufferPool& other) = delete;
+
+        ~AlignedBufferPool() noexcept;
+
+        AlignedBufferPool& operator=(const AlignedBufferPool& other) = delete;
+
+        [[nodiscard]]
+        size_t get_buffer_size() const noexcept {
+            return m_buffer_size;
+        }
+
+        [[nodiscard]]
+        size_t get_alignment() const noexcept {
+            return m_alignment;
+        }
+
+        [[nodiscard]]
+        bool is_aligned(const void* p) const noexcept {
+            return (reinterpret_cast<uintptr_t>(p) & (m_alignment - 1)) == 0;
+        }
+
+        [[nodiscard]]
+        Lease acquire();
+    };
+}
@@ -0,0 +1,188 @@
+#include "CachingBlockDevice.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+#include <vector>
+
+namespace vmgs {
+    CachingBlockDevice::CachingBlockDevice(std::unique_ptr<IBlockDevice>&& device, size_t cache_size)
+        : m_device{ std::move(device) }, m_block_size{ m_device->get_block_size() }, m_capacity{ cache_size / m_block_size }, m_unflushed{ false } {}
+
+    CachingBlockDevice::~CachingBlockDevice() noexcept {
+        // blocks still dirty here are lost, as they would be had the process died before `close`
+        try {
+            close();
+        } catch (...) {
+        }
+    }
+
+    CachingBlockDevice::CachedBlock* CachingBlockDevice::lookup(uint64_t lba) {
+        if (auto it = m_index.find(lba); it != m_index.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return &*it->second;
+        } else {
+            return nullptr;
+        }
+    }
+
+    CachingBlockDevice::CachedBlock& CachingBlockDevice::insert(uint64_t lba) {
+        if (m_lru.size() < m_capacity) {
+            m_lru.emplace_front(CachedBlock{ .lba = lba, .dirty = false, .data = std::make_unique<std::byte[]>(m_block_size) });
+        } else {
+            auto victim = std::prev(m_lru.end());
+
+            if (victim->dirty) {
+                write_back_around(victim->lba);
+            }
+
+            m_index.erase(victim->lba);
+
+            victim->lba = lba;
+            victim->dirty = false;
+            m_lru.splice(m_lru.begin(), m_lru, victim);
+        }
+
+        m_index.emplace(lba, m_lru.begin());
+        return m_lru.front();
+    }
+
+    void CachingBlockDevice::write_back_around(uint64_t lba) {
+        auto is_dirty = [this](uint64_t x) {
+            auto it = m_index.find(x);
+            return it != m_index.end() && it->second->dirty;
+        };
+
+        uint64_t first = lba;
+        while (0 < first && is_dirty(first - 1)) {
+            --first;
+        }
+
+        uint64_t last = lba;
+        while (is_dirty(last + 1)) {
+            ++last;
+        }
+
+        write_back_run(first, last - first + 1);
+    }
+
+    void CachingBlockDevice::write_back_run(uint64_t lba, uint64_t n) {
+        std::vector<std::span<const std::byte>> bufs;
+        bufs.reserve(n);
+
+        for (uint64_t i = 0; i < n; ++i) {
+            const auto& block = *m_index.at(lba + i);
+            bufs.emplace_back(block.data.get(), m_block_size);
+        }
+
+        m_device->writev_blocks(lba, bufs);
+        m_unflushed = true;
+
+        for (uint64_t i = 0; i < n; ++i) {
+            m_index.at(lba + i)->dirty = false;
+        }
+    }
+
+    void CachingBlockDevice::read_blocks(uint64_t lba, uint32_t n, void* buf) {
+        auto ptr = static_cast<std::byte*>(buf);
+
+        if (m_capacity < n) {
+            // too large to be cached, but dirty blocks in range must win over what the device has
+            m_device->read_blocks(lba, n, buf);
+
+            for (auto& block : m_lru) {
+                if (block.dirty && lba <= block.lba && block.lba - lba < n) {
+                    memcpy(ptr + (block.lba - lba) * m_block_size, block.data.get(), m_block_size);
+                }
+            }
+
+            return;
+        }
+
+        for (uint32_t i = 0; i < n;) {
+            if (auto block = lookup(lba + i)) {
+                memcpy(ptr + i * m_block_size, block->data.get(), m_block_size);
+                ++i;
+            } else {
+                // coalesce the whole run of missing blocks into a single device request
+                uint32_t j = i + 1;
+                while (j < n && !m_index.contains(lba + j)) {
+                    ++j;
+                }
+
+                m_device->read_blocks(lba + i, j - i, ptr + i * m_block_size);
+
+                for (; i < j; ++i) {
+                    memcpy(insert(lba + i).data.get(), ptr + i * m_block_size, m_block_size);
+                }
+            }
+        }
+    }
+
+    void CachingBlockDevice::write_blocks(uint64_t lba, uint32_t n, const void* buf) {
+        auto ptr = static_cast<const std::byte*>(buf);
+
+        if (m_capacity < n) {
+            m_device->write_blocks(lba, n, buf);
+            m_unflushed = true;
+
+            // keep cached copies coherent, they are now clean
+            for (auto& block : m_lru) {
+                if (lba <= block.lba && block.lba - lba < n) {
+                    memcpy(block.data.get(), ptr + (block.lba - lba) * m_block_size, m_block_size);
+                    block.dirty = false;
+                }
+            }
+
+            return;
+        }
+
+        for (uint32_t i = 0; i < n; ++i) {
+            auto block = lookup(lba + i);
+            if (block == nullptr) {
+                block = &insert(lba + i);
+            }
+
+            memcpy(block->data.get(), ptr + i * m_block_size, m_block_size);
+            block->dirty = true;
+        }
+    }
+
+    void CachingBlockDevice::flush() {
+        if (m_device) {
+            std::vector<uint64_t> dirty_lbas;
+            for (const auto& block : m_lru) {
+                if (block.dirty) {
+                    dirty_lbas.push_back(block.lba);
+                }
+            }
+
+            std::ranges::sort(dirty_lbas);
+
+            for (size_t i = 0; i < dirty_lbas.size();) {
+                size_t j = i + 1;
+                while (j < dirty_lbas.size() && dirty_lbas[j] == dirty_lbas[j - 1] + 1) {
+                    ++j;
+                }
+
+                write_back_run(dirty_lbas[i], j - i);
+                i = j;
+            }
+
+            if (m_unflushed) {
+                m_device->flush();
+                m_unflushed = false;
+            }
+        }
+    }
+
+    void CachingBlockDevice::close() {
+        if (m_device) {
+            flush();
+
+            m_index.clear();
+            m_lru.clear();
+            m_device.reset();
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "IBlockDevice.hpp"
+
+namespace vmgs {
+    // A decorator that keeps recently used blocks of another device in an LRU cache.
+    //
+    // Writes are write-back: they only dirty cached blocks, which reach the underlying device on `flush`, `close` or
+    // eviction. Adjacent dirty blocks are written back together with a single vectored request.
+    // Reads and writes larger than the whole cache bypass it.
+    //
+    // Not thread-safe.
+    class CachingBlockDevice : public IBlockDevice {
+    public:
+        static constexpr size_t DEFAULT_CACHE_SIZE = 1024 * 1024;
+
+    private:
+        struct CachedBlock {
+            uint64_t lba;
+            bool dirty;
+            std::unique_ptr<std::byte[]> data;
+        };
+
+        using lru_list_t = std::list<CachedBlock>;
+
+        std::unique_ptr<IBlockDevice> m_device;
+        size_t m_block_size;
+        size_t m_capacity;          // in blocks
+        bool m_unflushed;           // whether anything was written to the underlying device since its last flush
+        lru_list_t m_lru;           // most recently used first
+        std::unordered_map<uint64_t, lru_list_t::iterator> m_index;
+
+        [[nodiscard]]
+        CachedBlock* lookup(uint64_t lba);
+
+        // `lba` must not be cached yet
+        [[nodiscard]]
+        CachedBlock& insert(uint64_t lba);
+
+        // writes back the run of dirty blocks that contains `lba`
+        void write_back_around(uint64_t lba);
+
+        void write_back_run(uint64_t lba, uint64_t n);
+
+    public:
+        CachingBlockDevice(std::unique_ptr<IBlockDevice>&& device, size_t cache_size = DEFAULT_CACHE_SIZE);
+
+        CachingBlockDevice(const CachingBlockDevice& other) = delete;
+
+        virtual ~CachingBlockDevice() noexcept override;
+
+        CachingBlockDevice& operator=(const CachingBlockDevice& other) = delete;
+
+        [[nodiscard]]
+        virtual size_t get_block_size() const override {
+            return m_block_size;
+        }
+
+        [[nodiscard]]
+        virtual uint64_t get_block_count() const override {
+            return m_device->get_block_count();
+        }
+
+        [[nodiscard]]
+        size_t get_cached_block_count() const noexcept {
+            return m_lru.size();
+        }
+
+        virtual void read_blocks(uint64_t lba, uint32_t n, void* buf) override;
+
+        virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override;
+
+        // writes back every dirty block, then flushes the underlying device if anything was written to it
+        virtual void flush() override;
+
+        // flushes, then releases the underlying device
+        void close();
+    };
+}
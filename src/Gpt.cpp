@@ -189,21 +189,13 @@ namespace vmgs {
         {
             uint32_t header_checksum_ = endian_load<uint32_t, std::endian::little>(header_checksum);
 
-            uint32_t checksum = 0;
-            checksum = crc32_iso3309(checksum, signature);
-            checksum = crc32_iso3309(checksum, revision);
-            checksum = crc32_iso3309(checksum, header_size);
-            checksum = crc32_iso3309(checksum, decltype(header_checksum){});
-            checksum = crc32_iso3309(checksum, reserved_zero);
-            checksum = crc32_iso3309(checksum, std::as_bytes(std::span{ &current_lba, 1 }));
-            checksum = crc32_iso3309(checksum, std::as_bytes(std::span{ &backup_lba, 1 }));
-            checksum = crc32_iso3309(checksum, std::as_bytes(std::span{ &first_usable_lba, 1 }));
-            checksum = crc32_iso3309(checksum, std::as_bytes(std::span{ &last_usable_lba, 1 }));
-            checksum = crc32_iso3309(checksum, std::as_bytes(std::span{ &guid, 1 }));
-            checksum = crc32_iso3309(checksum, std::as_bytes(std::span{ &partition_entries_lba, 1 }));
-            checksum = crc32_iso3309(checksum, partition_entries_num);
-            checksum = crc32_iso3309(checksum, partition_entry_size);
-            checksum = crc32_iso3309(checksum, partition_entries_checksum);
+            // the header checksum field is summed as zeros
+            auto checksum_offset = offsetof(GptHeaderLayout, header_checksum);
+            auto rest_offset = checksum_offset + sizeof(header_checksum);
+
+            uint32_t checksum = crc32_iso3309(0, this, checksum_offset);
+            checksum = crc32_iso3309_zeros(checksum, sizeof(header_checksum));
+            checksum = crc32_iso3309(checksum, reinterpret_cast<const std::byte*>(this) + rest_offset, sizeof(GptHeaderLayout) - rest_offset);
 
             if (header_checksum_ != checksum) {
                 throw GptChecksumValidationError(std::format("Bad GPT header: Invalid checksum, expect 0x{:08x}, but got 0x{:08x}.", checksum, header_checksum_));
@@ -259,7 +251,74 @@ namespace vmgs {
         return m_partition_entries_num * sizeof(GptPartitionEntryLayout);
     }
 
-    Gpt Gpt::load_from(IBlockDevice& block_device) {
+    GptPartitionTable::GptPartitionTable(IBlockDevice& block_device, GptHeader&& header)
+        : m_block_device{ &block_device },
+          m_header{ std::move(header) },
+          m_blocks{ std::make_unique<std::byte[]>(m_header.partition_entries_lba_range(block_device.get_block_size()).length() * block_device.get_block_size()) },
+          m_loaded_blocks{ 0 },
+          m_checksum{ 0 } {}
+
+    void GptPartitionTable::load_through(uint32_t index) {
+        if (size() <= index) {
+            throw std::out_of_range(std::format("GPT partition entry {} is out of range.", index));
+        }
+
+        auto block_size = m_block_device->get_block_size();
+        auto lba_range = m_header.partition_entries_lba_range(block_size);
+        auto batch_blocks = std::max<uint64_t>(READ_BATCH_SIZE / block_size, 1);
+
+        uint64_t needed_blocks = ((static_cast<uint64_t>(index) + 1) * sizeof(GptPartitionEntryLayout) + block_size - 1) / block_size;
+        while (m_loaded_blocks < std::min(needed_blocks, lba_range.length())) {
+            auto n = std::min(batch_blocks, lba_range.length() - m_loaded_blocks);
+            auto p = m_blocks.get() + m_loaded_blocks * block_size;
+
+            m_block_device->read_blocks(lclosed_interval<uint64_t>{ .min = lba_range.min + m_loaded_blocks, .max = lba_range.min + m_loaded_blocks + n }, p);
+
+            // the CRC covers the entries only, not the padding of the last block
+            auto begin = m_loaded_blocks * block_size;
+            auto end = std::min<uint64_t>((m_loaded_blocks + n) * block_size, m_header.partition_entries_size());
+            if (begin < end) {
+                m_checksum = crc32_iso3309(m_checksum, p, end - begin);
+            }
+
+            m_loaded_blocks += n;
+        }
+    }
+
+    GptGuid GptPartitionTable::type_guid(uint32_t index) {
+        load_through(index);
+        return reinterpret_cast<const GptPartitionEntryLayout*>(m_blocks.get() + index * sizeof(GptPartitionEntryLayout))->type_guid.load();
+    }
+
+    GptPartitionEntry GptPartitionTable::entry(uint32_t index) {
+        load_through(index);
+        return reinterpret_cast<const GptPartitionEntryLayout*>(m_blocks.get() + index * sizeof(GptPartitionEntryLayout))->load(m_block_device->get_lba_range());
+    }
+
+    std::optional<GptPartitionEntry> GptPartitionTable::find_by_type(const GptGuid& type_guid) {
+        for (uint32_t i = 0; i < size(); ++i) {
+            if (this->type_guid(i) == type_guid) {
+                return entry(i);
+            }
+        }
+
+        verify();
+        return std::nullopt;
+    }
+
+    void GptPartitionTable::verify() {
+        if (0 < size()) {
+            load_through(size() - 1);
+        }
+
+        if (m_checksum != m_header.m_partition_entries_checksum) {
+            throw GptChecksumValidationError(
+                std::format("Bad GPT header: Invalid partition entries checksum, expect 0x{:08x}, but got 0x{:08x}.", m_checksum, m_header.m_partition_entries_checksum)
+            );
+        }
+    }
+
+    GptPartitionTable GptPartitionTable::load_from(IBlockDevice& block_device) {
         auto block_size = block_device.get_block_size();
         auto lba_range = block_device.get_lba_range();
 
@@ -267,23 +326,27 @@ namespace vmgs {
             throw std::runtime_error("Bad GPT: Insufficient data.");
         }
 
+        auto protective_mbr = std::make_unique<std::byte[]>(block_size);
+        auto header_block = std::make_unique<std::byte[]>(block_size);
+
         {
-            auto protective_mbr = std::make_unique<std::byte[]>(block_size);
+            BlockRequest requests[] = {
+                { .lba = 0, .n = 1, .buf = protective_mbr.get() },
+                { .lba = 1, .n = 1, .buf = header_block.get() }
+            };
 
-            block_device.read_blocks(0, 1, protective_mbr.get());
+            block_device.read_blocks(requests);
+        }
 
-            if (!(protective_mbr[block_size - 2] == std::byte{ 0x55 } && protective_mbr[block_size - 1] == std::byte{ 0xaa })) {
-                throw std::runtime_error("Bad GPT: No protective MBR.");
-            }
+        // the MBR is 512 bytes long whatever the block size is
+        if (!(protective_mbr[510] == std::byte{ 0x55 } && protective_mbr[511] == std::byte{ 0xaa })) {
+            throw std::runtime_error("Bad GPT: No protective MBR.");
         }
 
         GptHeader gpt_header;
         {
-            auto header_block = std::make_unique<std::byte[]>(block_size);
             auto header_layout = reinterpret_cast<GptHeaderLayout*>(header_block.get());
 
-            block_device.read_blocks(1, 1, header_block.get());
-
             try {
                 gpt_header = header_layout->load(lba_range, block_size);
             } catch (GptChecksumValidationError& e) {
@@ -292,48 +355,36 @@ namespace vmgs {
             }
         }
 
-        std::vector<GptPartitionEntry> gpt_partition_entries;
         {
-            auto partition_entries_size = gpt_header.partition_entries_size();
             auto partition_entries_lba_range = gpt_header.partition_entries_lba_range(block_size);
-            auto partition_entries_lba_range_size = partition_entries_lba_range.length() * block_size;
 
             if (partition_entries_lba_range.contains(0)) {
                 throw std::runtime_error("Bad GPT: Protective MBR overlapped with partition entries.");
             }
 
             if (partition_entries_lba_range.contains(std::to_underlying(gpt_header.current_lba()))) {
-                throw std::runtime_error("Bad GPT: Protective MBR overlapped with partition entries.");
+                throw std::runtime_error("Bad GPT: GPT header overlapped with partition entries.");
             }
 
             if (partition_entries_lba_range.contains(std::to_underlying(gpt_header.backup_lba()))) {
-                throw std::runtime_error("Bad GPT: Protective MBR overlapped with partition entries.");
+                throw std::runtime_error("Bad GPT: Backup GPT header overlapped with partition entries.");
             }
+        }
 
-            auto partition_entries_blocks = std::make_unique<std::byte[]>(partition_entries_lba_range_size);
-
-            block_device.read_blocks(partition_entries_lba_range, partition_entries_blocks.get());
-
-            auto checksum = crc32_iso3309(0, partition_entries_blocks.get(), partition_entries_size);
-
-            if (checksum == gpt_header.m_partition_entries_checksum) {
-                gpt_partition_entries.reserve(gpt_header.partition_entries_num());
+        return GptPartitionTable{ block_device, std::move(gpt_header) };
+    }
 
-                uint32_t i = 0;
-                for (auto w : std::span{ partition_entries_blocks.get(), partition_entries_lba_range_size } | std::views::chunk(sizeof(GptPartitionEntryLayout))) {
-                    if (i == gpt_header.partition_entries_num()) {
-                        break;
-                    }
+    Gpt Gpt::load_from(IBlockDevice& block_device) {
+        auto partition_table = GptPartitionTable::load_from(block_device);
+        partition_table.verify();
 
-                    gpt_partition_entries.emplace_back(reinterpret_cast<GptPartitionEntryLayout*>(w.data())->load(lba_range));
+        std::vector<GptPartitionEntry> gpt_partition_entries;
+        gpt_partition_entries.reserve(partition_table.size());
 
-                    ++i;
-                }
-            } else {
-                throw GptChecksumValidationError(std::format("Bad GPT header: Invalid partition entries checksum, expect 0x{:08x}, but got 0x{:08x}.", checksum, gpt_header.m_partition_entries_checksum));
-            }
+        for (uint32_t i = 0; i < partition_table.size(); ++i) {
+            gpt_partition_entries.emplace_back(partition_table.entry(i));
         }
 
-        return Gpt{ std::move(gpt_header), std::move(gpt_partition_entries) };
+        return Gpt{ GptHeader{ partition_table.header() }, std::move(gpt_partition_entries) };
     }
 }
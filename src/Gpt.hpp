@@ -4,6 +4,8 @@
 
 #include <algorithm>
 #include <array>
+#include <memory>
+#include <optional>
 #include <ranges>
 #include <vector>
 #include <utility>
@@ -38,6 +40,7 @@ namespace vmgs {
 
     class GptHeader {
         friend class Gpt;
+        friend class GptPartitionTable;
         friend struct GptHeaderLayout;
     private:
         GptLba m_current_lba;
@@ -152,6 +155,58 @@ namespace vmgs {
         }
     };
 
+    // A lazily read view of the partition entry array of a GPT disk.
+    //
+    // Blocks of the array are read in batches of `READ_BATCH_SIZE` bytes only as far as entries are asked for, and the
+    // CRC of the array is updated as each batch comes in; it is checked once the last batch has been read. Entries are
+    // parsed from the blocks on demand.
+    class GptPartitionTable {
+    public:
+        static constexpr size_t READ_BATCH_SIZE = 4096;
+
+    private:
+        IBlockDevice* m_block_device;
+        GptHeader m_header;
+        std::unique_ptr<std::byte[]> m_blocks;
+        uint64_t m_loaded_blocks;
+        uint32_t m_checksum;    // of the loaded part of the array
+
+        GptPartitionTable(IBlockDevice& block_device, GptHeader&& header);
+
+        // reads batches until entry `index` is loaded
+        void load_through(uint32_t index);
+
+    public:
+        [[nodiscard]]
+        const GptHeader& header() const noexcept {
+            return m_header;
+        }
+
+        [[nodiscard]]
+        uint32_t size() const noexcept {
+            return m_header.partition_entries_num();
+        }
+
+        [[nodiscard]]
+        GptGuid type_guid(uint32_t index);
+
+        [[nodiscard]]
+        GptPartitionEntry entry(uint32_t index);
+
+        // Returns the first entry of type `type_guid`, reading no further than the batch that holds it. Loaded entries
+        // are only checked against the CRC of the array when no entry matches, so a corrupt array can yield a bad
+        // match; that is only acceptable for read-only use, anyone about to write through the match must `verify` first.
+        [[nodiscard]]
+        std::optional<GptPartitionEntry> find_by_type(const GptGuid& type_guid);
+
+        // reads the rest of the array and checks its CRC
+        void verify();
+
+        // `block_device` must outlive the returned table
+        [[nodiscard]]
+        static GptPartitionTable load_from(IBlockDevice& block_device);
+    };
+
     class Gpt {
     private:
         GptHeader m_header;
@@ -0,0 +1,464 @@
+#include "GzipBlockDevice.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "endian_storage.hpp"
+
+namespace vmgs {
+    constexpr std::array<std::byte, 8> GZIP_INDEX_SIGNATURE =
+        { std::byte{'V'}, std::byte{'M'}, std::byte{'G'}, std::byte{'S'},
+          std::byte{'G'}, std::byte{'Z'}, std::byte{'I'}, std::byte{'X'} };
+
+    constexpr uint32_t GZIP_INDEX_VERSION = 1;
+
+    // gzip wrapper only, with the largest window
+    constexpr int GZIP_WINDOW_BITS = 16 + MAX_WBITS;
+
+    // of the compressed file, read at a time
+    constexpr size_t INPUT_CHUNK_SIZE = 64 * 1024;
+
+    // of output, given to zlib at a time
+    constexpr size_t OUTPUT_CHUNK_SIZE = 1024 * 1024 * 1024;
+
+    struct GzipIndexHeaderLayout {
+        std::array<std::byte, 8> signature;
+        std::array<std::byte, 4> version;
+        std::array<std::byte, 4> point_count;
+        std::array<std::byte, 8> file_size;
+        std::array<std::byte, 8> file_trailer;  // the last 8 bytes of the file, i.e. CRC32 and ISIZE of the last member
+        std::array<std::byte, 8> image_size;
+    };
+
+    static_assert(sizeof(GzipIndexHeaderLayout) == 40);
+    static_assert(alignof(GzipIndexHeaderLayout) == alignof(std::byte));
+
+    // followed by `window_size` bytes of compressed window
+    struct GzipIndexPointLayout {
+        std::array<std::byte, 8> out;
+        std::array<std::byte, 8> in;
+        std::array<std::byte, 4> bits;
+        std::array<std::byte, 4> window_size;
+    };
+
+    static_assert(sizeof(GzipIndexPointLayout) == 24);
+    static_assert(alignof(GzipIndexPointLayout) == alignof(std::byte));
+
+    // Decompresses a gzip file from a given offset, carrying on into the next member whenever a member ends.
+    class GzipInflater {
+    private:
+        IBlockDevice& m_file;
+        uint64_t m_file_size;
+        uint64_t m_offset;          // of the end of buffered input
+        bool m_raw;                 // whether the gzip header of the current member was skipped
+        bool m_finished;
+        z_stream m_stream;
+        std::vector<Bytef> m_input;
+
+        // makes at least `size` bytes of input available unless the file ends first, returns how many are available
+        size_t fill(size_t size) {
+            if (m_stream.avail_in < size && m_offset < m_file_size) {
+                if (0 < m_stream.avail_in) {
+                    memmove(m_input.data(), m_stream.next_in, m_stream.avail_in);
+                }
+
+                auto len = static_cast<uInt>(std::min<uint64_t>(m_input.size() - m_stream.avail_in, m_file_size - m_offset));
+                m_file.read_blocks(m_offset, len, m_input.data() + m_stream.avail_in);
+
+                m_stream.next_in = m_input.data();
+                m_stream.avail_in += len;
+                m_offset += len;
+            }
+            return m_stream.avail_in;
+        }
+
+        void skip_input(size_t size) noexcept {
+            m_stream.next_in += size;
+            m_stream.avail_in -= static_cast<uInt>(size);
+        }
+
+        void next_member() {
+            if (m_raw) {
+                if (fill(8) < 8) {
+                    throw std::runtime_error("Bad gzip image: Unexpected end of file.");
+                }
+                skip_input(8);  // CRC32 and ISIZE
+            }
+
+            // like gzip, anything after the last member that is not another member is ignored
+            if (fill(2) < 2 || m_stream.next_in[0] != 0x1f || m_stream.next_in[1] != 0x8b) {
+                m_finished = true;
+                return;
+            }
+
+            if (inflateReset2(&m_stream, GZIP_WINDOW_BITS) != Z_OK) {
+                throw std::runtime_error("Failed to reset zlib stream.");
+            }
+            m_raw = false;
+        }
+
+    public:
+        GzipInflater(IBlockDevice& file, uint64_t offset, bool raw)
+            : m_file{ file }, m_file_size{ file.get_block_count() }, m_offset{ offset }, m_raw{ raw }, m_finished{}, m_stream{}, m_input(INPUT_CHUNK_SIZE)
+        {
+            auto ret = inflateInit2(&m_stream, raw ? -MAX_WBITS : GZIP_WINDOW_BITS);
+            if (ret == Z_MEM_ERROR) {
+                throw std::bad_alloc();
+            } else if (ret != Z_OK) {
+                throw std::runtime_error("Failed to initialize zlib stream.");
+            }
+        }
+
+        GzipInflater(const GzipInflater& other) = delete;
+
+        ~GzipInflater() noexcept {
+            inflateEnd(&m_stream);
+        }
+
+        GzipInflater& operator=(const GzipInflater& other) = delete;
+
+        [[nodiscard]]
+        bool finished() const noexcept {
+            return m_finished;
+        }
+
+        // offset in the file of the first byte not fully consumed
+        [[nodiscard]]
+        uint64_t position() const noexcept {
+            return m_offset - m_stream.avail_in;
+        }
+
+        [[nodiscard]]
+        int data_type() const noexcept {
+            return m_stream.data_type;
+        }
+
+        // feeds the high `bits` bits of the next byte
+        void prime(uint32_t bits) {
+            if (fill(1) < 1) {
+                throw std::runtime_error("Bad gzip image: Unexpected end of file.");
+            }
+
+            auto value = m_stream.next_in[0] >> (8 - bits);
+            skip_input(1);
+
+            if (inflatePrime(&m_stream, static_cast<int>(bits), value) != Z_OK) {
+                throw std::runtime_error("Failed to prime zlib stream.");
+            }
+        }
+
+        void set_dictionary(std::span<const Bytef> dictionary) {
+            if (inflateSetDictionary(&m_stream, dictionary.data(), static_cast<uInt>(dictionary.size())) != Z_OK) {
+                throw std::runtime_error("Failed to set dictionary of zlib stream.");
+            }
+        }
+
+        // Returns how many bytes are written to `out`, which is fewer than `size` only when the last member ends.
+        // With `Z_BLOCK`, returns at the next deflate block boundary as well.
+        size_t inflate(void* out, size_t size, int flush = Z_NO_FLUSH) {
+            m_stream.next_out = static_cast<Bytef*>(out);
+            m_stream.avail_out = static_cast<uInt>(size);
+
+            while (!m_finished && 0 < m_stream.avail_out) {
+                if (fill(1) == 0) {
+                    throw std::runtime_error("Bad gzip image: Unexpected end of file.");
+                }
+
+                auto ret = ::inflate(&m_stream, flush);
+                if (ret == Z_STREAM_END) {
+                    next_member();
+                } else if (ret == Z_MEM_ERROR) {
+                    throw std::bad_alloc();
+                } else if (ret != Z_OK) {
+                    throw std::runtime_error(std::format("Bad gzip image: {}.", m_stream.msg ? m_stream.msg : "Corrupted deflate stream"));
+                }
+
+                if (flush == Z_BLOCK) {
+                    break;
+                }
+            }
+
+            return size - m_stream.avail_out;
+        }
+    };
+
+    GzipBlockDevice::GzipBlockDevice() noexcept
+        : m_file{}, m_file_size{}, m_image_size{}, m_block_size{}, m_points{}, m_cursor{}, m_cursor_out{} {}
+
+    GzipBlockDevice::GzipBlockDevice(GzipBlockDevice&& other) noexcept = default;
+
+    GzipBlockDevice::~GzipBlockDevice() noexcept = default;
+
+    GzipBlockDevice& GzipBlockDevice::operator=(GzipBlockDevice&& other) noexcept = default;
+
+    std::unique_ptr<GzipInflater> GzipBlockDevice::start_at(const AccessPoint& point) {
+        auto retval = std::make_unique<GzipInflater>(*m_file, point.in - (point.bits ? 1 : 0), true);
+
+        if (point.bits) {
+            retval->prime(point.bits);
+        }
+
+        if (0 < point.out) {
+            std::vector<Bytef> window(std::min<uint64_t>(point.out, WINDOW_SIZE));
+
+            auto window_size = static_cast<uLongf>(window.size());
+            auto ret = uncompress(window.data(), &window_size, reinterpret_cast<const Bytef*>(point.window.data()), static_cast<uLong>(point.window.size()));
+            if (ret != Z_OK || window_size != window.size()) {
+                throw std::runtime_error("Bad gzip index: Corrupted window.");
+            }
+
+            retval->set_dictionary(window);
+        }
+
+        return retval;
+    }
+
+    void GzipBlockDevice::build_index() {
+        GzipInflater inflater{ *m_file, 0, false };
+
+        std::vector<Bytef> window(WINDOW_SIZE);     // output goes round and round in it
+        size_t window_pos = 0;
+
+        uint64_t out = 0;
+        uint64_t last_out = 0;
+
+        m_points.clear();
+        while (!inflater.finished()) {
+            if (window_pos == window.size()) {
+                window_pos = 0;
+            }
+
+            auto len = inflater.inflate(window.data() + window_pos, window.size() - window_pos, Z_BLOCK);
+            window_pos += len;
+            out += len;
+
+            // at a block boundary that is not the end of a member
+            auto data_type = inflater.data_type();
+            if ((data_type & 128) && !(data_type & 64) && (m_points.empty() || ACCESS_POINT_SPAN <= out - last_out)) {
+                std::vector<Bytef> history(std::min<uint64_t>(out, WINDOW_SIZE));
+                if (window_pos < history.size()) {
+                    auto tail = history.size() - window_pos;
+                    std::copy_n(window.end() - tail, tail, history.begin());
+                    std::copy_n(window.begin(), window_pos, history.begin() + tail);
+                } else {
+                    std::copy_n(window.begin() + (window_pos - history.size()), history.size(), history.begin());
+                }
+
+                auto compressed_size = compressBound(static_cast<uLong>(history.size()));
+                std::vector<std::byte> compressed(compressed_size);
+                if (compress(reinterpret_cast<Bytef*>(compressed.data()), &compressed_size, history.data(), static_cast<uLong>(history.size())) != Z_OK) {
+                    throw std::runtime_error("Failed to compress window of access point.");
+                }
+                compressed.resize(compressed_size);
+
+                m_points.push_back(
+                    AccessPoint{ .out = out, .in = inflater.position(), .bits = static_cast<uint32_t>(data_type & 7), .window = std::move(compressed) }
+                );
+                last_out = out;
+            }
+        }
+
+        if (m_points.empty()) {
+            throw std::runtime_error("Bad gzip image: No deflate block is found.");
+        }
+
+        m_image_size = out;
+    }
+
+    bool GzipBlockDevice::load_index(const std::filesystem::path& index_path) {
+        std::ifstream index_file{ index_path, std::ios::binary };
+        if (!index_file) {
+            return false;
+        }
+
+        GzipIndexHeaderLayout header;
+        if (!index_file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            return false;
+        }
+
+        std::array<std::byte, 8> file_trailer{};
+        if (8 <= m_file_size) {
+            m_file->read_blocks(m_file_size - 8, 8, file_trailer.data());
+        }
+
+        // the index was saved for some other file, or for an older version of this one
+        if (header.signature != GZIP_INDEX_SIGNATURE ||
+            endian_load<uint32_t, std::endian::little>(header.version) != GZIP_INDEX_VERSION ||
+            endian_load<uint64_t, std::endian::little>(header.file_size) != m_file_size ||
+            header.file_trailer != file_trailer)
+        {
+            return false;
+        }
+
+        auto point_count = endian_load<uint32_t, std::endian::little>(header.point_count);
+        auto image_size = endian_load<uint64_t, std::endian::little>(header.image_size);
+
+        std::vector<AccessPoint> points;
+        for (uint32_t i = 0; i < point_count; ++i) {
+            GzipIndexPointLayout point;
+            if (!index_file.read(reinterpret_cast<char*>(&point), sizeof(point))) {
+                return false;
+            }
+
+            auto out = endian_load<uint64_t, std::endian::little>(point.out);
+            auto in = endian_load<uint64_t, std::endian::little>(point.in);
+            auto bits = endian_load<uint32_t, std::endian::little>(point.bits);
+            auto window_size = endian_load<uint32_t, std::endian::little>(point.window_size);
+
+            if (image_size < out || m_file_size < in || (in == 0 && 0 < bits) || 7 < bits || compressBound(WINDOW_SIZE) < window_size) {
+                return false;
+            }
+
+            if (!points.empty() && out <= points.back().out) {
+                return false;
+            }
+
+            std::vector<std::byte> window(window_size);
+            if (!index_file.read(reinterpret_cast<char*>(window.data()), window_size)) {
+                return false;
+            }
+
+            points.push_back(AccessPoint{ .out = out, .in = in, .bits = bits, .window = std::move(window) });
+        }
+
+        if (points.empty() || points.front().out != 0) {
+            return false;
+        }
+
+        m_points = std::move(points);
+        m_image_size = image_size;
+        return true;
+    }
+
+    void GzipBlockDevice::save_index(const std::filesystem::path& index_path) const {
+        GzipIndexHeaderLayout header;
+        header.signature = GZIP_INDEX_SIGNATURE;
+        endian_store<uint32_t, std::endian::little>(header.version, GZIP_INDEX_VERSION);
+        endian_store<uint32_t, std::endian::little>(header.point_count, static_cast<uint32_t>(m_points.size()));
+        endian_store<uint64_t, std::endian::little>(header.file_size, m_file_size);
+        header.file_trailer = {};
+        if (8 <= m_file_size) {
+            m_file->read_blocks(m_file_size - 8, 8, header.file_trailer.data());
+        }
+        endian_store<uint64_t, std::endian::little>(header.image_size, m_image_size);
+
+        std::ofstream index_file{ index_path, std::ios::binary | std::ios::trunc };
+        index_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (const auto& point : m_points) {
+            GzipIndexPointLayout layout;
+            endian_store<uint64_t, std::endian::little>(layout.out, point.out);
+            endian_store<uint64_t, std::endian::little>(layout.in, point.in);
+            endian_store<uint32_t, std::endian::little>(layout.bits, point.bits);
+            endian_store<uint32_t, std::endian::little>(layout.window_size, static_cast<uint32_t>(point.window.size()));
+
+            index_file.write(reinterpret_cast<const char*>(&layout), sizeof(layout));
+            index_file.write(reinterpret_cast<const char*>(point.window.data()), static_cast<std::streamsize>(point.window.size()));
+        }
+
+        if (!index_file.flush()) {
+            throw std::runtime_error(std::format("Failed to save gzip index to `{}`.", index_path.string()));
+        }
+    }
+
+    void GzipBlockDevice::read_blocks(uint64_t lba, uint32_t n, void* buf) {
+        if (get_block_count() < lba || get_block_count() - lba < n) {
+            throw std::out_of_range(std::format("Gzip image access out of range: [0x{:x}, 0x{:x}).", lba, lba + n));
+        }
+
+        uint64_t offset = lba * m_block_size;
+        uint64_t size = uint64_t{ n } * m_block_size;
+
+        auto point = std::prev(std::ranges::upper_bound(m_points, offset, {}, &AccessPoint::out));
+
+        // a failed read leaves no cursor behind
+        auto cursor = std::move(m_cursor);
+        uint64_t cursor_out = m_cursor_out;
+        if (!cursor || offset < cursor_out || cursor_out < point->out) {
+            cursor = start_at(*point);
+            cursor_out = point->out;
+        }
+
+        if (cursor_out < offset) {
+            std::vector<std::byte> discard(std::min<uint64_t>(offset - cursor_out, WINDOW_SIZE));
+            while (cursor_out < offset) {
+                auto len = cursor->inflate(discard.data(), std::min<uint64_t>(offset - cursor_out, discard.size()));
+                if (len == 0) {
+                    throw std::runtime_error("Bad gzip image: Unexpected end of data.");
+                }
+                cursor_out += len;
+            }
+        }
+
+        auto p = static_cast<std::byte*>(buf);
+        while (0 < size) {
+            auto len = cursor->inflate(p, std::min<uint64_t>(size, OUTPUT_CHUNK_SIZE));
+            if (len == 0) {
+                throw std::runtime_error("Bad gzip image: Unexpected end of data.");
+            }
+            p += len;
+            size -= len;
+            cursor_out += len;
+        }
+
+        m_cursor = std::move(cursor);
+        m_cursor_out = cursor_out;
+    }
+
+    void GzipBlockDevice::write_blocks(uint64_t, uint32_t, const void*) {
+        throw std::runtime_error("Gzip-compressed image is read-only.");
+    }
+
+    bool GzipBlockDevice::probe(IBlockDevice& file) {
+        auto block_size = file.get_block_size();
+        auto n = (2 + block_size - 1) / block_size;
+        if (file.get_block_count() < n) {
+            return false;
+        }
+
+        std::vector<uint8_t> head(n * block_size);
+        file.read_blocks(0, static_cast<uint32_t>(n), head.data());
+        return head[0] == 0x1f && head[1] == 0x8b;
+    }
+
+    GzipBlockDevice GzipBlockDevice::open(std::unique_ptr<IBlockDevice> file, size_t block_size, const std::optional<std::filesystem::path>& index_path) {
+        if (file->get_block_size() != 1) {
+            throw std::invalid_argument("Gzip file must be opened with 1-byte blocks.");
+        }
+
+        if (block_size == 0) {
+            throw std::invalid_argument("Bad image block size.");
+        }
+
+        GzipBlockDevice retval;
+        retval.m_file = std::move(file);
+        retval.m_file_size = retval.m_file->get_block_count();
+        retval.m_block_size = block_size;
+
+        if (!index_path.has_value() || !retval.load_index(index_path.value())) {
+            retval.build_index();
+            if (index_path.has_value()) {
+                retval.save_index(index_path.value());
+            }
+        }
+
+        if (retval.m_image_size % block_size != 0) {
+            throw std::runtime_error(
+                std::format("Bad gzip image: Decompressed size 0x{:x} is not a multiple of block size {}.", retval.m_image_size, block_size)
+            );
+        }
+
+        return retval;
+    }
+}
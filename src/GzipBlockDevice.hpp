@@ -0,0 +1,106 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "IBlockDevice.hpp"
+
+namespace vmgs {
+    class GzipInflater;
+
+    // A read-only block device over a gzip-compressed image, which may consist of several gzip members.
+    //
+    // The image is decompressed once when opened to build an index of access points, one at a deflate block boundary
+    // roughly every `ACCESS_POINT_SPAN` bytes of output, each holding the 32 KiB of output before it (compressed). A
+    // read then decompresses from the nearest access point before it only, or carries on from where the previous read
+    // stopped when that is closer. The index can be saved next to the image, so that only the first open pays for the
+    // full decompression.
+    //
+    // See `zran.c` in the zlib distribution.
+    class GzipBlockDevice : public IBlockDevice {
+    public:
+        static constexpr size_t DEFAULT_BLOCK_SIZE = 512;
+
+        static constexpr uint64_t ACCESS_POINT_SPAN = 1024 * 1024;
+
+        // the most deflate can look back
+        static constexpr size_t WINDOW_SIZE = 32 * 1024;
+
+    private:
+        struct AccessPoint {
+            uint64_t out;                   // offset in the decompressed image
+            uint64_t in;                    // offset in the file of the first byte not fully consumed
+            uint32_t bits;                  // bits of the byte before `in` that have not been consumed, 0 to 7
+            std::vector<std::byte> window;  // compressed, of the `min(out, WINDOW_SIZE)` bytes of output before `out`
+        };
+
+        std::unique_ptr<IBlockDevice> m_file;   // with 1-byte blocks
+        uint64_t m_file_size;
+        uint64_t m_image_size;
+        size_t m_block_size;
+        std::vector<AccessPoint> m_points;      // sorted by `out`
+
+        std::unique_ptr<GzipInflater> m_cursor; // where the previous read stopped
+        uint64_t m_cursor_out;
+
+        GzipBlockDevice() noexcept;
+
+        [[nodiscard]]
+        std::unique_ptr<GzipInflater> start_at(const AccessPoint& point);
+
+        void build_index();
+
+        [[nodiscard]]
+        bool load_index(const std::filesystem::path& index_path);
+
+    public:
+        GzipBlockDevice(GzipBlockDevice&& other) noexcept;
+
+        GzipBlockDevice(const GzipBlockDevice& other) = delete;
+
+        virtual ~GzipBlockDevice() noexcept override;
+
+        GzipBlockDevice& operator=(GzipBlockDevice&& other) noexcept;
+
+        GzipBlockDevice& operator=(const GzipBlockDevice& other) = delete;
+
+        [[nodiscard]]
+        virtual size_t get_block_size() const override {
+            return m_block_size;
+        }
+
+        [[nodiscard]]
+        virtual uint64_t get_block_count() const override {
+            return m_image_size / m_block_size;
+        }
+
+        [[nodiscard]]
+        size_t get_access_point_count() const noexcept {
+            return m_points.size();
+        }
+
+        virtual void read_blocks(uint64_t lba, uint32_t n, void* buf) override;
+
+        virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override;
+
+        void save_index(const std::filesystem::path& index_path) const;
+
+        // Whether `file` starts with the gzip magic.
+        [[nodiscard]]
+        static bool probe(IBlockDevice& file);
+
+        // `file` must be opened with 1-byte blocks, as a gzip file can have any length.
+        // With `index_path`, the index is loaded from there if it was saved for this very file, or else built and saved
+        // there.
+        [[nodiscard]]
+        static GzipBlockDevice open(
+            std::unique_ptr<IBlockDevice> file,
+            size_t block_size = DEFAULT_BLOCK_SIZE,
+            const std::optional<std::filesystem::path>& index_path = std::nullopt
+        );
+    };
+}
@@ -1,7 +1,67 @@
 #include "IBlockDevice.hpp"
+#include <algorithm>
+#include <cstring>
 #include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
 namespace vmgs {
+    namespace {
+        uint64_t total_blocks_of(auto bufs, size_t block_size) {
+            uint64_t n = 0;
+            for (const auto& buf : bufs) {
+                if (buf.size() % block_size != 0) {
+                    throw std::invalid_argument("Buffer size is not a multiple of block size.");
+                }
+                n += buf.size() / block_size;
+            }
+            return n;
+        }
+    }
+
+    void IBlockDevice::readv_blocks(uint64_t lba, std::span<const std::span<std::byte>> bufs) {
+        auto block_size = get_block_size();
+        auto n = total_blocks_of(bufs, block_size);
+
+        if (bufs.size() == 1) {
+            read_blocks(lclosed_interval<uint64_t>{ .min = lba, .max = lba + n }, bufs[0].data());
+        } else if (0 < n) {
+            auto bounce_buf = std::make_unique<std::byte[]>(n * block_size);
+
+            read_blocks(lclosed_interval<uint64_t>{ .min = lba, .max = lba + n }, bounce_buf.get());
+
+            std::byte* p = bounce_buf.get();
+            for (const auto& buf : bufs) {
+                if (!buf.empty()) {
+                    memcpy(buf.data(), p, buf.size());
+                    p += buf.size();
+                }
+            }
+        }
+    }
+
+    void IBlockDevice::writev_blocks(uint64_t lba, std::span<const std::span<const std::byte>> bufs) {
+        auto block_size = get_block_size();
+        auto n = total_blocks_of(bufs, block_size);
+
+        if (bufs.size() == 1) {
+            write_blocks(lclosed_interval<uint64_t>{ .min = lba, .max = lba + n }, bufs[0].data());
+        } else if (0 < n) {
+            auto bounce_buf = std::make_unique<std::byte[]>(n * block_size);
+
+            std::byte* p = bounce_buf.get();
+            for (const auto& buf : bufs) {
+                if (!buf.empty()) {
+                    memcpy(p, buf.data(), buf.size());
+                    p += buf.size();
+                }
+            }
+
+            write_blocks(lclosed_interval<uint64_t>{ .min = lba, .max = lba + n }, bounce_buf.get());
+        }
+    }
+
     void IBlockDevice::read_blocks(lclosed_interval<uint64_t> lba_range, void* buf) {
         auto block_size = get_block_size();
         for (auto current_lba = lba_range.min; current_lba < lba_range.max;) {
@@ -14,6 +74,70 @@ namespace vmgs {
         }
     }
 
+    void IBlockDevice::read_blocks(std::span<const BlockRequest> requests, uint32_t max_gap) {
+        auto block_size = get_block_size();
+
+        std::vector<const BlockRequest*> sorted_requests;
+        sorted_requests.reserve(requests.size());
+        for (const auto& request : requests) {
+            if (0 < request.n) {
+                sorted_requests.push_back(&request);
+            }
+        }
+
+        std::ranges::sort(sorted_requests, {}, &BlockRequest::lba);
+
+        // shared by every gap, its content is discarded
+        std::unique_ptr<std::byte[]> gap_buf;
+
+        for (size_t i = 0; i < sorted_requests.size();) {
+            auto group_min = sorted_requests[i]->lba;
+            auto group_max = group_min + sorted_requests[i]->n;
+            bool overlapped = false;
+
+            size_t j = i + 1;
+            for (; j < sorted_requests.size() && sorted_requests[j]->lba <= group_max + max_gap; ++j) {
+                overlapped = overlapped || sorted_requests[j]->lba < group_max;
+                group_max = std::max(group_max, sorted_requests[j]->lba + sorted_requests[j]->n);
+            }
+
+            auto group = std::span{ sorted_requests }.subspan(i, j - i);
+            auto group_range = lclosed_interval<uint64_t>{ .min = group_min, .max = group_max };
+
+            if (group.size() == 1) {
+                read_blocks(group_range, group[0]->buf);
+            } else if (!overlapped) {
+                std::vector<std::span<std::byte>> bufs;
+                bufs.reserve(group.size() * 2);
+
+                auto current_lba = group_min;
+                for (auto request : group) {
+                    if (current_lba < request->lba) {
+                        if (!gap_buf) {
+                            gap_buf = std::make_unique<std::byte[]>(static_cast<size_t>(max_gap) * block_size);
+                        }
+                        bufs.emplace_back(gap_buf.get(), (request->lba - current_lba) * block_size);
+                    }
+
+                    bufs.emplace_back(static_cast<std::byte*>(request->buf), static_cast<size_t>(request->n) * block_size);
+                    current_lba = request->lba + request->n;
+                }
+
+                readv_blocks(group_min, bufs);
+            } else {
+                auto group_buf = std::make_unique<std::byte[]>(group_range.length() * block_size);
+
+                read_blocks(group_range, group_buf.get());
+
+                for (auto request : group) {
+                    memcpy(request->buf, group_buf.get() + (request->lba - group_min) * block_size, static_cast<size_t>(request->n) * block_size);
+                }
+            }
+
+            i = j;
+        }
+    }
+
     void IBlockDevice::write_blocks(lclosed_interval<uint64_t> lba_range, const void* buf) {
         auto block_size = get_block_size();
         for (auto current_lba = lba_range.min; current_lba < lba_range.max;) {
@@ -1,11 +1,22 @@
 #pragma once
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <span>
 
 #include "interval.hpp"
 
 namespace vmgs {
+    struct BlockRequest {
+        uint64_t lba;
+        uint32_t n;
+        void* buf;
+    };
+
     struct IBlockDevice {
+        // default `max_gap` of the scatter-gather `read_blocks`, in blocks
+        static constexpr uint32_t DEFAULT_COALESCE_GAP = 8;
+
         virtual ~IBlockDevice() noexcept = default;
 
         [[nodiscard]]
@@ -23,8 +34,30 @@ namespace vmgs {
 
         virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) = 0;
 
+        // Makes previously written blocks durable.
+        virtual void flush() {}
+
+        // Vectored I/O: blocks starting at `lba` are scattered into / gathered from `bufs` in order.
+        // The size of every buffer must be a multiple of block size.
+        // The default implementation issues a single device request through a bounce buffer.
+        virtual void readv_blocks(uint64_t lba, std::span<const std::span<std::byte>> bufs);
+
+        virtual void writev_blocks(uint64_t lba, std::span<const std::span<const std::byte>> bufs);
+
+        // Returns a pointer to blocks `[lba, lba + n)` that stays valid for as long as the returned pointer is alive,
+        // or null if the device cannot expose its storage directly.
+        [[nodiscard]]
+        virtual std::shared_ptr<const std::byte> map_blocks(uint64_t /* lba */, uint64_t /* n */) {
+            return nullptr;
+        }
+
         void read_blocks(lclosed_interval<uint64_t> lba_range, void* buf);
 
+        // Scatter-gather read. Requests are sorted by LBA and those that are adjacent, overlapping or separated by at
+        // most `max_gap` blocks are merged into a single device request; the data is then scattered back into each
+        // request's buffer. Devices that can have many requests in flight at once may serve them without merging.
+        virtual void read_blocks(std::span<const BlockRequest> requests, uint32_t max_gap = DEFAULT_COALESCE_GAP);
+
         void write_blocks(lclosed_interval<uint64_t> lba_range, const void* buf);
     };
 }
@@ -0,0 +1,123 @@
+#include "MmapBlockDevice.hpp"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+namespace vmgs {
+    void MmapBlockDevice::read_blocks(uint64_t lba, uint32_t n, void* buf) {
+        if (0 < n) {
+            if (get_block_count() < lba || get_block_count() - lba < n) {
+                throw std::runtime_error("Read end of device.");
+            }
+
+            if (!m_mapping) {
+                throw std::runtime_error("Device is closed.");
+            }
+
+            memcpy(buf, m_mapping.get() + lba * m_block_size, static_cast<size_t>(n) * m_block_size);
+        }
+    }
+
+    void MmapBlockDevice::write_blocks(uint64_t lba, uint32_t n, const void* buf) {
+        if (0 < n) {
+            if (!m_mapping) {
+                throw std::runtime_error("Device is closed.");
+            }
+
+            if (!m_writable) {
+                throw std::system_error(EBADF, std::generic_category());
+            }
+
+            if (get_block_count() < lba || get_block_count() - lba < n) {
+                throw std::runtime_error("Some blocks are not written.");
+            }
+
+            memcpy(m_mapping.get() + lba * m_block_size, buf, static_cast<size_t>(n) * m_block_size);
+        }
+    }
+
+    void MmapBlockDevice::flush() {
+        if (m_mapping && m_writable) {
+            if (::msync(m_mapping.get(), static_cast<size_t>(m_device_size), MS_SYNC) < 0) {
+                throw std::system_error(errno, std::generic_category());
+            }
+        }
+    }
+
+    std::shared_ptr<const std::byte> MmapBlockDevice::map_blocks(uint64_t lba, uint64_t n) {
+        if (m_mapping && lba <= get_block_count() && n <= get_block_count() - lba) {
+            return std::shared_ptr<const std::byte>{ m_mapping, m_mapping.get() + lba * m_block_size };
+        } else {
+            return nullptr;
+        }
+    }
+
+    void MmapBlockDevice::close() noexcept {
+        m_mapping.reset();
+    }
+
+    MmapBlockDevice MmapBlockDevice::open(std::string_view path, bool writable, size_t block_size) {
+        MmapBlockDevice retval;
+
+        int fd = ::open(path.data(), writable ? O_RDWR : O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category());
+        }
+
+        // the mapping outlives the descriptor
+        std::unique_ptr<int, decltype([](int* p) { ::close(*p); })> fd_guard{ &fd };
+
+        struct stat64 st;
+        if (::fstat64(fd, &st) < 0) {
+            throw std::system_error(errno, std::generic_category());
+        }
+
+        if (S_ISBLK(st.st_mode)) {
+            uint32_t logical_block_size;
+
+            if (::ioctl(fd, BLKSSZGET, &logical_block_size) < 0) {
+                throw std::system_error(errno, std::generic_category());
+            }
+
+            if (::ioctl(fd, BLKGETSIZE64, &retval.m_device_size) < 0) {
+                throw std::system_error(errno, std::generic_category());
+            }
+
+            retval.m_block_size = logical_block_size;
+        } else if (S_ISREG(st.st_mode)) {
+            if (block_size == 0) {
+                throw std::invalid_argument("Block size must be positive.");
+            }
+
+            retval.m_device_size = static_cast<uint64_t>(st.st_size);
+            retval.m_block_size = block_size;
+        } else {
+            throw std::system_error(ENODEV, std::generic_category());
+        }
+
+        retval.m_writable = writable;
+
+        if (0 < retval.m_device_size) {
+            auto mapping_size = static_cast<size_t>(retval.m_device_size);
+
+            void* p = ::mmap(nullptr, mapping_size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                throw std::system_error(errno, std::generic_category());
+            }
+
+            retval.m_mapping = std::shared_ptr<std::byte>{
+                static_cast<std::byte*>(p), [mapping_size](std::byte* q) { ::munmap(q, mapping_size); }
+            };
+        }
+
+        return retval;
+    }
+}
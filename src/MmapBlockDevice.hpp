@@ -0,0 +1,76 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "IBlockDevice.hpp"
+
+namespace vmgs {
+    // A block device over a memory-mapped image file or block device.
+    // Mapped views returned by `map_blocks` keep the mapping alive even after the device is closed.
+    class MmapBlockDevice : public IBlockDevice {
+    public:
+        // used for regular files, which carry no logical block size of their own
+        static constexpr size_t DEFAULT_BLOCK_SIZE = 512;
+
+    private:
+        std::shared_ptr<std::byte> m_mapping;
+        size_t m_block_size;
+        uint64_t m_device_size;
+        bool m_writable;
+
+        MmapBlockDevice() noexcept
+            : m_mapping{}, m_block_size{}, m_device_size{}, m_writable{} {}
+
+    public:
+        MmapBlockDevice(MmapBlockDevice&& other) noexcept :
+            m_mapping{ std::move(other.m_mapping) },
+            m_block_size{ std::exchange(other.m_block_size, 0) },
+            m_device_size{ std::exchange(other.m_device_size, 0) },
+            m_writable{ std::exchange(other.m_writable, false) } {}
+
+        MmapBlockDevice(const MmapBlockDevice& other) = delete;
+
+        virtual ~MmapBlockDevice() noexcept override {
+            this->close();
+        }
+
+        MmapBlockDevice& operator=(MmapBlockDevice&& other) noexcept {
+            this->close();
+
+            m_mapping = std::move(other.m_mapping);
+            m_block_size = std::exchange(other.m_block_size, 0);
+            m_device_size = std::exchange(other.m_device_size, 0);
+            m_writable = std::exchange(other.m_writable, false);
+
+            return *this;
+        }
+
+        MmapBlockDevice& operator=(const MmapBlockDevice& other) = delete;
+
+        [[nodiscard]]
+        virtual size_t get_block_size() const override {
+            return m_block_size;
+        }
+
+        [[nodiscard]]
+        virtual uint64_t get_block_count() const override {
+            return m_device_size / m_block_size;
+        }
+
+        virtual void read_blocks(uint64_t lba, uint32_t n, void* buf) override;
+
+        virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override;
+
+        virtual void flush() override;
+
+        [[nodiscard]]
+        virtual std::shared_ptr<const std::byte> map_blocks(uint64_t lba, uint64_t n) override;
+
+        void close() noexcept;
+
+        // `block_size` is ignored when `path` refers to a block device.
+        [[nodiscard]]
+        static MmapBlockDevice open(std::string_view path, bool writable, size_t block_size = DEFAULT_BLOCK_SIZE);
+    };
+}
@@ -0,0 +1,70 @@
+#include "PartitionBlockDevice.hpp"
+
+#include <format>
+#include <stdexcept>
+
+namespace vmgs {
+    PartitionBlockDevice::PartitionBlockDevice(IBlockDevice& disk, lclosed_interval<uint64_t> lba_range)
+        : m_disk{ disk }, m_lba_range{ lba_range }
+    {
+        if (m_lba_range.max < m_lba_range.min || disk.get_block_count() < m_lba_range.max) {
+            throw std::out_of_range(
+                std::format("Partition [0x{:x}, 0x{:x}) exceeds the disk of 0x{:x} blocks.", m_lba_range.min, m_lba_range.max, disk.get_block_count())
+            );
+        }
+    }
+
+    void PartitionBlockDevice::check_range(uint64_t lba, uint64_t n) const {
+        if (get_block_count() < lba || get_block_count() - lba < n) {
+            throw std::out_of_range(std::format("Partition access out of range: [0x{:x}, 0x{:x}).", lba, lba + n));
+        }
+    }
+
+    void PartitionBlockDevice::read_blocks(uint64_t lba, uint32_t n, void* buf) {
+        check_range(lba, n);
+        m_disk.read_blocks(m_lba_range.min + lba, n, buf);
+    }
+
+    void PartitionBlockDevice::write_blocks(uint64_t lba, uint32_t n, const void* buf) {
+        check_range(lba, n);
+        m_disk.write_blocks(m_lba_range.min + lba, n, buf);
+    }
+
+    void PartitionBlockDevice::read_blocks(std::span<const BlockRequest> requests, uint32_t max_gap) {
+        // forwarded as a whole, so that the disk can serve the batch its own way
+        std::vector<BlockRequest> disk_requests;
+        disk_requests.reserve(requests.size());
+
+        for (const auto& request : requests) {
+            check_range(request.lba, request.n);
+            disk_requests.push_back(BlockRequest{ .lba = m_lba_range.min + request.lba, .n = request.n, .buf = request.buf });
+        }
+
+        m_disk.read_blocks(disk_requests, max_gap);
+    }
+
+    void PartitionBlockDevice::readv_blocks(uint64_t lba, std::span<const std::span<std::byte>> bufs) {
+        uint64_t size = 0;
+        for (const auto& buf : bufs) {
+            size += buf.size();
+        }
+
+        check_range(lba, size / get_block_size());
+        m_disk.readv_blocks(m_lba_range.min + lba, bufs);
+    }
+
+    void PartitionBlockDevice::writev_blocks(uint64_t lba, std::span<const std::span<const std::byte>> bufs) {
+        uint64_t size = 0;
+        for (const auto& buf : bufs) {
+            size += buf.size();
+        }
+
+        check_range(lba, size / get_block_size());
+        m_disk.writev_blocks(m_lba_range.min + lba, bufs);
+    }
+
+    std::shared_ptr<const std::byte> PartitionBlockDevice::map_blocks(uint64_t lba, uint64_t n) {
+        check_range(lba, n);
+        return m_disk.map_blocks(m_lba_range.min + lba, n);
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "interval.hpp"
+#include "IBlockDevice.hpp"
+#include "Gpt.hpp"
+
+namespace vmgs {
+    // A view of blocks `[lba_range.min, lba_range.max)` of another device, e.g. a partition of a raw disk image, of a
+    // `/dev/nbdX` device or of a virtual disk. The underlying device must outlive the view.
+    class PartitionBlockDevice : public IBlockDevice {
+    private:
+        IBlockDevice& m_disk;
+        lclosed_interval<uint64_t> m_lba_range;
+
+        void check_range(uint64_t lba, uint64_t n) const;
+
+    public:
+        PartitionBlockDevice(IBlockDevice& disk, lclosed_interval<uint64_t> lba_range);
+
+        PartitionBlockDevice(IBlockDevice& disk, const GptPartitionEntry& partition)
+            : PartitionBlockDevice{ disk, partition.lba_range() } {}
+
+        [[nodiscard]]
+        virtual size_t get_block_size() const override {
+            return m_disk.get_block_size();
+        }
+
+        [[nodiscard]]
+        virtual uint64_t get_block_count() const override {
+            return m_lba_range.length();
+        }
+
+        virtual void read_blocks(uint64_t lba, uint32_t n, void* buf) override;
+
+        virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override;
+
+        virtual void read_blocks(std::span<const BlockRequest> requests, uint32_t max_gap = DEFAULT_COALESCE_GAP) override;
+
+        virtual void flush() override {
+            m_disk.flush();
+        }
+
+        virtual void readv_blocks(uint64_t lba, std::span<const std::span<std::byte>> bufs) override;
+
+        virtual void writev_blocks(uint64_t lba, std::span<const std::span<const std::byte>> bufs) override;
+
+        [[nodiscard]]
+        virtual std::shared_ptr<const std::byte> map_blocks(uint64_t lba, uint64_t n) override;
+    };
+}
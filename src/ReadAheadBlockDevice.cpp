@@ -0,0 +1,83 @@
+#include "ReadAheadBlockDevice.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace vmgs {
+    ReadAheadBlockDevice::ReadAheadBlockDevice(std::unique_ptr<IBlockDevice>&& device, size_t window_size)
+        : m_device{ std::move(device) },
+          m_block_size{ m_device->get_block_size() },
+          m_window_capacity{ window_size / m_block_size },
+          m_window_range{ .min = 0, .max = 0 },
+          m_window{} {}
+
+    void ReadAheadBlockDevice::read_blocks(uint64_t lba, uint32_t n, void* buf) {
+        if (n == 0) {
+            return;
+        }
+
+        if (m_window_range.min <= lba && lba + n <= m_window_range.max) {
+            memcpy(buf, m_window.get() + (lba - m_window_range.min) * m_block_size, static_cast<size_t>(n) * m_block_size);
+        } else if (m_window_capacity <= n || get_block_count() <= lba) {
+            m_device->read_blocks(lba, n, buf);
+        } else {
+            if (!m_window) {
+                m_window = std::make_unique<std::byte[]>(m_window_capacity * m_block_size);
+            }
+
+            // the window never extends past the end of the device, but always covers the request
+            auto window_range = lclosed_interval<uint64_t>{ .min = lba, .max = std::min(lba + m_window_capacity, get_block_count()) };
+            window_range.max = std::max(window_range.max, lba + n);
+
+            m_window_range = lclosed_interval<uint64_t>{ .min = 0, .max = 0 };
+            m_device->read_blocks(window_range, m_window.get());
+            m_window_range = window_range;
+
+            memcpy(buf, m_window.get(), static_cast<size_t>(n) * m_block_size);
+        }
+    }
+
+    void ReadAheadBlockDevice::readv_blocks(uint64_t lba, std::span<const std::span<std::byte>> bufs) {
+        uint64_t n = 0;
+        for (const auto& buf : bufs) {
+            n += buf.size() / m_block_size;
+        }
+
+        if (m_window_capacity <= n) {
+            m_device->readv_blocks(lba, bufs);
+        } else {
+            IBlockDevice::readv_blocks(lba, bufs);
+        }
+    }
+
+    void ReadAheadBlockDevice::update_window(uint64_t lba, uint64_t n, const std::byte* buf) noexcept {
+        auto overlap_min = std::max(lba, m_window_range.min);
+        auto overlap_max = std::min(lba + n, m_window_range.max);
+        if (overlap_min < overlap_max) {
+            memcpy(
+                m_window.get() + (overlap_min - m_window_range.min) * m_block_size,
+                buf + (overlap_min - lba) * m_block_size,
+                (overlap_max - overlap_min) * m_block_size
+            );
+        }
+    }
+
+    void ReadAheadBlockDevice::write_blocks(uint64_t lba, uint32_t n, const void* buf) {
+        m_device->write_blocks(lba, n, buf);
+        update_window(lba, n, static_cast<const std::byte*>(buf));
+    }
+
+    void ReadAheadBlockDevice::writev_blocks(uint64_t lba, std::span<const std::span<const std::byte>> bufs) {
+        m_device->writev_blocks(lba, bufs);
+
+        for (const auto& buf : bufs) {
+            auto n = buf.size() / m_block_size;
+            update_window(lba, n, buf.data());
+            lba += n;
+        }
+    }
+
+    void ReadAheadBlockDevice::discard() noexcept {
+        m_window_range = lclosed_interval<uint64_t>{ .min = 0, .max = 0 };
+        m_window.reset();
+    }
+}
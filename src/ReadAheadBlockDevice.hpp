@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include "interval.hpp"
+#include "IBlockDevice.hpp"
+
+namespace vmgs {
+    // A decorator that serves reads from a single in-memory window.
+    //
+    // A read that misses the window reloads it with `window_size` bytes starting at the read position, so a chain of
+    // small dependent reads close to each other (protective MBR, GPT header and entries; VMGS headers and payload)
+    // costs one device request. Reads larger than the window bypass it. Writes go through and keep the window coherent.
+    class ReadAheadBlockDevice : public IBlockDevice {
+    public:
+        static constexpr size_t DEFAULT_WINDOW_SIZE = 64 * 1024;
+
+    private:
+        std::unique_ptr<IBlockDevice> m_device;
+        size_t m_block_size;
+        uint64_t m_window_capacity;     // in blocks
+        lclosed_interval<uint64_t> m_window_range;
+        std::unique_ptr<std::byte[]> m_window;
+
+        // copies the part of blocks `[lba, lba + n)` written from `buf` that the window holds
+        void update_window(uint64_t lba, uint64_t n, const std::byte* buf) noexcept;
+
+    public:
+        ReadAheadBlockDevice(std::unique_ptr<IBlockDevice>&& device, size_t window_size = DEFAULT_WINDOW_SIZE);
+
+        ReadAheadBlockDevice(const ReadAheadBlockDevice& other) = delete;
+
+        ReadAheadBlockDevice& operator=(const ReadAheadBlockDevice& other) = delete;
+
+        [[nodiscard]]
+        virtual size_t get_block_size() const override {
+            return m_block_size;
+        }
+
+        [[nodiscard]]
+        virtual uint64_t get_block_count() const override {
+            return m_device->get_block_count();
+        }
+
+        [[nodiscard]]
+        lclosed_interval<uint64_t> get_window_range() const noexcept {
+            return m_window_range;
+        }
+
+        virtual void read_blocks(uint64_t lba, uint32_t n, void* buf) override;
+
+        virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override;
+
+        virtual void flush() override {
+            m_device->flush();
+        }
+
+        // Like `read_blocks`, vectored reads larger than the window, e.g. of a whole payload, bypass it and go to the
+        // underlying device without a bounce buffer.
+        virtual void readv_blocks(uint64_t lba, std::span<const std::span<std::byte>> bufs) override;
+
+        virtual void writev_blocks(uint64_t lba, std::span<const std::span<const std::byte>> bufs) override;
+
+        [[nodiscard]]
+        virtual std::shared_ptr<const std::byte> map_blocks(uint64_t lba, uint64_t n) override {
+            return m_device->map_blocks(lba, n);
+        }
+
+        // drops the window
+        void discard() noexcept;
+    };
+}
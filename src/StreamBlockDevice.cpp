@@ -0,0 +1,74 @@
+#include "StreamBlockDevice.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace vmgs {
+    void StreamBlockDevice::read_fully(void* buf, size_t size) {
+        auto ptr = static_cast<std::byte*>(buf);
+
+        while (0 < size) {
+            auto actual_size = ::read(m_fd, ptr, size);
+            if (actual_size < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category());
+            } else if (actual_size == 0) {
+                throw std::runtime_error("Read end of stream.");
+            }
+
+            ptr += actual_size;
+            size -= static_cast<size_t>(actual_size);
+        }
+    }
+
+    void StreamBlockDevice::read_blocks(uint64_t lba, uint32_t n, void* buf) {
+        if (lba < m_position) {
+            throw std::runtime_error(std::format("Stream is read forward only, but block 0x{:x} has gone by.", lba));
+        }
+
+        if (get_block_count() - lba < n) {
+            throw std::out_of_range(std::format("Stream access out of range: [0x{:x}, 0x{:x}).", lba, lba + n));
+        }
+
+        if (m_position < lba) {
+            auto scratch_n = std::min<uint64_t>(lba - m_position, std::max<size_t>(SKIP_BUFFER_SIZE / m_block_size, 1));
+
+            std::vector<std::byte> scratch(scratch_n * m_block_size);
+            while (m_position < lba) {
+                auto len = std::min<uint64_t>(lba - m_position, scratch_n);
+                read_fully(scratch.data(), len * m_block_size);
+                m_position += len;
+            }
+        }
+
+        read_fully(buf, static_cast<size_t>(n) * m_block_size);
+        m_position += n;
+    }
+
+    void StreamBlockDevice::write_blocks(uint64_t, uint32_t, const void*) {
+        throw std::runtime_error("Stream is read-only.");
+    }
+
+    StreamBlockDevice StreamBlockDevice::open(int fd, size_t block_size) {
+        if (fd < 0) {
+            throw std::system_error(EBADF, std::generic_category());
+        }
+
+        if (block_size == 0) {
+            throw std::invalid_argument("Bad stream block size.");
+        }
+
+        StreamBlockDevice retval;
+        retval.m_fd = fd;
+        retval.m_block_size = block_size;
+        retval.m_position = 0;
+        return retval;
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+#include "IBlockDevice.hpp"
+
+namespace vmgs {
+    // A read-only block device over a pipe, a socket or any other file descriptor that can only be read forward, e.g.
+    // the stdin of `ssh host cat disk.img | ...`.
+    //
+    // Blocks are read in the order they are asked for, and the blocks in between are read into a scratch buffer and
+    // dropped, so nothing is kept but what the caller reads. Asking for a block that has already gone by is an error.
+    // The parsers of the GPT and VMGS headers only ever read forward, and the VMGS payload comes after the headers.
+    //
+    // The length of a stream is not known up front, so the device claims to be as large as possible; reading past the
+    // end of the stream is an error.
+    class StreamBlockDevice : public IBlockDevice {
+    public:
+        static constexpr size_t DEFAULT_BLOCK_SIZE = 512;
+
+        static constexpr size_t SKIP_BUFFER_SIZE = 64 * 1024;
+
+    private:
+        int m_fd;
+        size_t m_block_size;
+        uint64_t m_position;    // the next block to come out of the stream
+
+        StreamBlockDevice() noexcept
+            : m_fd(-1), m_block_size{}, m_position{} {}
+
+        void read_fully(void* buf, size_t size);
+
+    public:
+        StreamBlockDevice(StreamBlockDevice&& other) noexcept :
+            m_fd{ std::exchange(other.m_fd, -1) },
+            m_block_size{ std::exchange(other.m_block_size, 0) },
+            m_position{ std::exchange(other.m_position, 0) } {}
+
+        StreamBlockDevice(const StreamBlockDevice& other) = delete;
+
+        StreamBlockDevice& operator=(StreamBlockDevice&& other) noexcept {
+            m_fd = std::exchange(other.m_fd, -1);
+            m_block_size = std::exchange(other.m_block_size, 0);
+            m_position = std::exchange(other.m_position, 0);
+            return *this;
+        }
+
+        StreamBlockDevice& operator=(const StreamBlockDevice& other) = delete;
+
+        [[nodiscard]]
+        virtual size_t get_block_size() const override {
+            return m_block_size;
+        }
+
+        [[nodiscard]]
+        virtual uint64_t get_block_count() const override {
+            return std::numeric_limits<uint64_t>::max() / m_block_size;
+        }
+
+        [[nodiscard]]
+        uint64_t get_position() const noexcept {
+            return m_position;
+        }
+
+        virtual void read_blocks(uint64_t lba, uint32_t n, void* buf) override;
+
+        virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override;
+
+        // `fd` is borrowed, and must outlive the device.
+        [[nodiscard]]
+        static StreamBlockDevice open(int fd, size_t block_size = DEFAULT_BLOCK_SIZE);
+    };
+}
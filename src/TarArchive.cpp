@@ -0,0 +1,248 @@
+#include "TarArchive.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <format>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+
+namespace vmgs {
+    constexpr std::array<char, 6> TAR_USTAR_MAGIC = { 'u', 's', 't', 'a', 'r', '\0' };
+
+    struct TarHeaderLayout {
+        std::array<char, 100> name;
+        std::array<char, 8> mode;
+        std::array<char, 8> uid;
+        std::array<char, 8> gid;
+        std::array<char, 12> size;
+        std::array<char, 12> mtime;
+        std::array<char, 8> checksum;
+        std::array<char, 1> type_flag;
+        std::array<char, 100> link_name;
+        std::array<char, 6> magic;
+        std::array<char, 2> version;
+        std::array<char, 32> user_name;
+        std::array<char, 32> group_name;
+        std::array<char, 8> device_major;
+        std::array<char, 8> device_minor;
+        std::array<char, 155> prefix;       // ustar only, GNU tar keeps other things here
+        std::array<char, 12> padding;
+    };
+
+    static_assert(sizeof(TarHeaderLayout) == TarArchive::BLOCK_SIZE);
+    static_assert(alignof(TarHeaderLayout) == alignof(char));
+
+    namespace {
+        // up to the first NUL
+        template<size_t Cnt>
+        [[nodiscard]]
+        std::string_view load_string(const std::array<char, Cnt>& field) noexcept {
+            return std::string_view{ field.data(), std::ranges::find(field, '\0') };
+        }
+
+        // octal digits padded with spaces or NULs, or a big-endian base-256 number flagged by the top bit (GNU tar)
+        template<size_t Cnt>
+        [[nodiscard]]
+        uint64_t load_number(const std::array<char, Cnt>& field, uint64_t lba) {
+            auto bytes = std::span{ reinterpret_cast<const uint8_t*>(field.data()), Cnt };
+
+            if (bytes[0] & 0x80) {
+                if (bytes[0] != 0x80) {
+                    throw std::runtime_error(std::format("Bad tar archive: Negative number in header at block 0x{:x}.", lba));
+                }
+
+                uint64_t retval = 0;
+                for (auto v : bytes.subspan(1)) {
+                    if (retval >> 56) {
+                        throw std::runtime_error(std::format("Bad tar archive: Number out of range in header at block 0x{:x}.", lba));
+                    }
+                    retval = retval << 8 | v;
+                }
+                return retval;
+            }
+
+            auto first = std::find_if(field.data(), field.data() + Cnt, [](char c) { return c != ' ' && c != '\0'; });
+            auto last = std::find_if(first, field.data() + Cnt, [](char c) { return c == ' ' || c == '\0'; });
+
+            uint64_t retval = 0;
+            auto [ptr, ec] = std::from_chars(first, last, retval, 8);
+            if (first != last && (ec != std::errc{} || ptr != last)) {
+                throw std::runtime_error(std::format("Bad tar archive: Bad number in header at block 0x{:x}.", lba));
+            }
+
+            return retval;
+        }
+
+        [[nodiscard]]
+        bool is_valid_checksum(const TarHeaderLayout& header, uint64_t lba) {
+            auto bytes = std::span{ reinterpret_cast<const uint8_t*>(&header), sizeof(TarHeaderLayout) };
+            auto checksum_offset = offsetof(TarHeaderLayout, checksum);
+
+            // the checksum field is summed as if it were spaces; some old tars summed signed chars
+            uint64_t sum = ' ' * sizeof(header.checksum);
+            int64_t signed_sum = ' ' * sizeof(header.checksum);
+            for (size_t i = 0; i < bytes.size(); ++i) {
+                if (i < checksum_offset || checksum_offset + sizeof(header.checksum) <= i) {
+                    sum += bytes[i];
+                    signed_sum += static_cast<int8_t>(bytes[i]);
+                }
+            }
+
+            auto expect = load_number(header.checksum, lba);
+            return expect == sum || static_cast<int64_t>(expect) == signed_sum;
+        }
+
+        [[nodiscard]]
+        std::string normalize_name(std::string_view name) {
+            while (true) {
+                if (name.starts_with("./")) {
+                    name.remove_prefix(2);
+                } else if (name.starts_with('/')) {
+                    name.remove_prefix(1);
+                } else {
+                    break;
+                }
+            }
+            return std::string{ name };
+        }
+
+        // `path` and `size` records of a pax extended header, each of which is "<length> <key>=<value>\n"
+        void parse_pax_records(std::string_view records, std::optional<std::string>& path, std::optional<uint64_t>& size, uint64_t lba) {
+            auto bad = [lba]() {
+                return std::runtime_error(std::format("Bad tar archive: Bad pax extended header at block 0x{:x}.", lba));
+            };
+
+            while (!records.empty() && records.front() != '\0') {
+                size_t length = 0;
+                auto [ptr, ec] = std::from_chars(records.data(), records.data() + records.size(), length);
+                if (ec != std::errc{} || ptr == records.data() + records.size() || *ptr != ' ' || length == 0 || records.size() < length || records[length - 1] != '\n') {
+                    throw bad();
+                }
+
+                auto record = records.substr(ptr + 1 - records.data(), length - (ptr + 1 - records.data()) - 1);
+                records.remove_prefix(length);
+
+                auto eq = record.find('=');
+                if (eq == std::string_view::npos) {
+                    throw bad();
+                }
+
+                auto key = record.substr(0, eq);
+                auto value = record.substr(eq + 1);
+                if (key == "path") {
+                    path = std::string{ value };
+                } else if (key == "size") {
+                    uint64_t v = 0;
+                    auto [vptr, vec] = std::from_chars(value.data(), value.data() + value.size(), v);
+                    if (vec != std::errc{} || vptr != value.data() + value.size()) {
+                        throw bad();
+                    }
+                    size = v;
+                }
+            }
+        }
+    }
+
+    TarMemberBlockDevice::TarMemberBlockDevice(std::shared_ptr<IBlockDevice> archive, const TarMember& member)
+        : PartitionBlockDevice{
+              *archive,
+              lclosed_interval<uint64_t>{ .min = member.data_lba, .max = member.data_lba + (member.size + TarArchive::BLOCK_SIZE - 1) / TarArchive::BLOCK_SIZE }
+          },
+          m_archive{ std::move(archive) } {}
+
+    const TarMember* TarArchive::find(std::string_view name) const {
+        auto normalized = normalize_name(name);
+
+        auto iter = std::ranges::find(m_members | std::views::reverse, normalized, &TarMember::name);
+        return iter != (m_members | std::views::reverse).end() ? &*iter : nullptr;
+    }
+
+    std::unique_ptr<IBlockDevice> TarArchive::open_member(std::string_view name) const {
+        auto member = find(name);
+        if (member == nullptr) {
+            throw std::runtime_error(std::format("Tar archive has no member `{}`.", name));
+        }
+
+        return std::make_unique<TarMemberBlockDevice>(m_archive, *member);
+    }
+
+    TarArchive TarArchive::open(std::shared_ptr<IBlockDevice> archive) {
+        if (archive->get_block_size() != BLOCK_SIZE) {
+            throw std::invalid_argument(std::format("Tar archive must be opened with {}-byte blocks.", BLOCK_SIZE));
+        }
+
+        TarArchive retval;
+        retval.m_archive = std::move(archive);
+
+        auto block_count = retval.m_archive->get_block_count();
+
+        // from a pax extended header or a GNU long name, for the next member only
+        std::optional<std::string> next_name;
+        std::optional<uint64_t> next_size;
+
+        for (uint64_t lba = 0; lba < block_count;) {
+            TarHeaderLayout header;
+            retval.m_archive->read_blocks(lba, 1, &header);
+
+            // the end-of-archive marker
+            if (std::ranges::all_of(std::as_bytes(std::span{ &header, 1 }), [](auto v) { return v == std::byte{}; })) {
+                break;
+            }
+
+            if (!is_valid_checksum(header, lba)) {
+                throw std::runtime_error(std::format("Bad tar archive: Invalid header checksum at block 0x{:x}.", lba));
+            }
+
+            auto type_flag = header.type_flag[0];
+            bool is_regular_file = type_flag == '0' || type_flag == '\0' || type_flag == '7';
+
+            auto size = is_regular_file ? next_size.value_or(load_number(header.size, lba)) : load_number(header.size, lba);
+            auto data_lba = lba + 1;
+            auto data_n = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+            if (block_count - data_lba < data_n) {
+                throw std::runtime_error(std::format("Bad tar archive: Member at block 0x{:x} exceeds end of archive.", lba));
+            }
+
+            if (type_flag == 'x' || type_flag == 'L') {
+                if (MAX_EXTENDED_HEADER_SIZE < size) {
+                    throw std::runtime_error(std::format("Bad tar archive: Extended header at block 0x{:x} is too large.", lba));
+                }
+
+                std::string data(data_n * BLOCK_SIZE, '\0');
+                retval.m_archive->read_blocks(data_lba, static_cast<uint32_t>(data_n), data.data());
+                data.resize(size);
+
+                if (type_flag == 'x') {
+                    parse_pax_records(data, next_name, next_size, lba);
+                } else {
+                    next_name = std::string{ data.c_str() };
+                }
+            } else {
+                if (is_regular_file) {
+                    std::string name;
+                    if (next_name.has_value()) {
+                        name = std::move(next_name.value());
+                    } else if (header.magic == TAR_USTAR_MAGIC && !load_string(header.prefix).empty()) {
+                        name = std::string{ load_string(header.prefix) } + "/" + std::string{ load_string(header.name) };
+                    } else {
+                        name = load_string(header.name);
+                    }
+
+                    retval.m_members.push_back(TarMember{ .name = normalize_name(name), .data_lba = data_lba, .size = size });
+                }
+
+                next_name.reset();
+                next_size.reset();
+            }
+
+            lba = data_lba + data_n;
+        }
+
+        return retval;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "IBlockDevice.hpp"
+#include "PartitionBlockDevice.hpp"
+
+namespace vmgs {
+    // A regular file stored in a tar archive.
+    struct TarMember {
+        std::string name;       // without leading `./` or `/`
+        uint64_t data_lba;      // in 512-byte blocks of the archive
+        uint64_t size;          // in bytes
+    };
+
+    // A member of a tar archive as a block device of 512-byte blocks. The padding of the last block reads as stored,
+    // which is zeros in any archive written by tar. The device keeps the archive alive.
+    class TarMemberBlockDevice : public PartitionBlockDevice {
+    private:
+        std::shared_ptr<IBlockDevice> m_archive;
+
+    public:
+        TarMemberBlockDevice(std::shared_ptr<IBlockDevice> archive, const TarMember& member);
+    };
+
+    // The index of the regular files of a ustar, GNU or pax tar archive.
+    //
+    // Only the member headers are read, by hopping from one to the next over the data in between, so indexing a large
+    // export costs one 512-byte read per member. The archive can be any device of 512-byte blocks, e.g. a
+    // `GzipBlockDevice` over a .tar.gz file.
+    class TarArchive {
+    public:
+        static constexpr size_t BLOCK_SIZE = 512;
+
+        // the most bytes of a pax extended header or a GNU long name that are read
+        static constexpr uint64_t MAX_EXTENDED_HEADER_SIZE = 1024 * 1024;
+
+    private:
+        std::shared_ptr<IBlockDevice> m_archive;
+        std::vector<TarMember> m_members;   // in archive order
+
+        TarArchive() noexcept
+            : m_archive{}, m_members{} {}
+
+    public:
+        TarArchive(TarArchive&& other) noexcept = default;
+
+        TarArchive(const TarArchive& other) = delete;
+
+        TarArchive& operator=(TarArchive&& other) noexcept = default;
+
+        TarArchive& operator=(const TarArchive& other) = delete;
+
+        [[nodiscard]]
+        const std::vector<TarMember>& members() const noexcept {
+            return m_members;
+        }
+
+        // When a name occurs more than once, the last member wins, as it does when the archive is extracted.
+        [[nodiscard]]
+        const TarMember* find(std::string_view name) const;
+
+        [[nodiscard]]
+        std::unique_ptr<IBlockDevice> open_member(std::string_view name) const;
+
+        [[nodiscard]]
+        static TarArchive open(std::shared_ptr<IBlockDevice> archive);
+    };
+}
@@ -2,49 +2,227 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <linux/fs.h>
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
 #include <system_error>
 
 namespace vmgs {
+    namespace {
+        template<typename BufTy>
+        std::vector<iovec> make_iovecs(std::span<const BufTy> bufs, size_t block_size) {
+            std::vector<iovec> retval;
+            retval.reserve(bufs.size());
+
+            for (const auto& buf : bufs) {
+                if (buf.size() % block_size != 0) {
+                    throw std::invalid_argument("Buffer size is not a multiple of block size.");
+                }
+
+                if (!buf.empty()) {
+                    retval.emplace_back(iovec{ .iov_base = const_cast<std::byte*>(buf.data()), .iov_len = buf.size() });
+                }
+            }
+
+            return retval;
+        }
+
+        void pread_fully(int fd, void* buf, size_t size, off64_t offset) {
+            auto ptr = static_cast<std::byte*>(buf);
+
+            while (0 < size) {
+                auto actual_size = ::pread64(fd, ptr, size, offset);
+                if (actual_size < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::system_error(errno, std::generic_category());
+                } else if (actual_size == 0) {
+                    throw std::runtime_error("Read end of device.");
+                }
+
+                ptr += actual_size;
+                offset += actual_size;
+                size -= static_cast<size_t>(actual_size);
+            }
+        }
+
+        void pwrite_fully(int fd, const void* buf, size_t size, off64_t offset) {
+            auto ptr = static_cast<const std::byte*>(buf);
+
+            while (0 < size) {
+                auto actual_size = ::pwrite64(fd, ptr, size, offset);
+                if (actual_size < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::system_error(errno, std::generic_category());
+                } else if (actual_size == 0) {
+                    throw std::runtime_error("Some blocks are not written.");
+                }
+
+                ptr += actual_size;
+                offset += actual_size;
+                size -= static_cast<size_t>(actual_size);
+            }
+        }
+
+        template<typename BufTy>
+        [[nodiscard]]
+        bool all_aligned(std::span<const BufTy> bufs, const AlignedBufferPool& pool) noexcept {
+            return std::ranges::all_of(bufs, [&pool](const auto& buf) { return pool.is_aligned(buf.data()); });
+        }
+
+        // drops the first `size` bytes from `iov[i:]`, returns the new `i`
+        size_t advance_iovecs(std::vector<iovec>& iov, size_t i, size_t size) noexcept {
+            while (i < iov.size() && iov[i].iov_len <= size) {
+                size -= iov[i].iov_len;
+                ++i;
+            }
+
+            if (0 < size) {
+                iov[i].iov_base = reinterpret_cast<std::byte*>(iov[i].iov_base) + size;
+                iov[i].iov_len -= size;
+            }
+
+            return i;
+        }
+    }
+
     UnixBlockDevice::~UnixBlockDevice() {
         close();
     }
 
+    void UnixBlockDevice::read_blocks_direct(uint64_t lba, uint32_t n, void* buf) {
+        auto bounce_buf = m_aligned_buffer_pool->acquire();
+        auto offset = static_cast<off64_t>(lba * m_block_size);
+        auto ptr = static_cast<std::byte*>(buf);
+
+        while (0 < n) {
+            auto len = static_cast<uint32_t>(std::min<size_t>(n, ALIGNED_BUFFER_SIZE_IN_BLOCKS));
+            auto size = static_cast<size_t>(len) * m_block_size;
+
+            pread_fully(m_fd, bounce_buf.get(), size, offset);
+            memcpy(ptr, bounce_buf.get(), size);
+
+            n -= len;
+            ptr += size;
+            offset += size;
+        }
+    }
+
+    void UnixBlockDevice::write_blocks_direct(uint64_t lba, uint32_t n, const void* buf) {
+        auto bounce_buf = m_aligned_buffer_pool->acquire();
+        auto offset = static_cast<off64_t>(lba * m_block_size);
+        auto ptr = static_cast<const std::byte*>(buf);
+
+        while (0 < n) {
+            auto len = static_cast<uint32_t>(std::min<size_t>(n, ALIGNED_BUFFER_SIZE_IN_BLOCKS));
+            auto size = static_cast<size_t>(len) * m_block_size;
+
+            memcpy(bounce_buf.get(), ptr, size);
+            pwrite_fully(m_fd, bounce_buf.get(), size, offset);
+
+            n -= len;
+            ptr += size;
+            offset += size;
+        }
+    }
+
     void UnixBlockDevice::read_blocks(uint64_t lba, uint32_t n, void* buf) {
         if (0 < n) {
-            size_t expected_size = n * m_block_size;
+            if (m_aligned_buffer_pool && !m_aligned_buffer_pool->is_aligned(buf)) {
+                read_blocks_direct(lba, n, buf);
+            } else {
+                pread_fully(m_fd, buf, static_cast<size_t>(n) * m_block_size, static_cast<off64_t>(lba * m_block_size));
+            }
+        }
+    }
 
-            if (::lseek64(m_fd, lba * m_block_size, SEEK_SET) < 0) {
-                throw std::system_error(errno, std::generic_category());
+    void UnixBlockDevice::write_blocks(uint64_t lba, uint32_t n, const void* buf) {
+        if (0 < n) {
+            if (m_aligned_buffer_pool && !m_aligned_buffer_pool->is_aligned(buf)) {
+                write_blocks_direct(lba, n, buf);
+            } else {
+                pwrite_fully(m_fd, buf, static_cast<size_t>(n) * m_block_size, static_cast<off64_t>(lba * m_block_size));
+            }
+        }
+    }
+
+    void UnixBlockDevice::readv_blocks(uint64_t lba, std::span<const std::span<std::byte>> bufs) {
+        if (m_aligned_buffer_pool && !all_aligned(bufs, *m_aligned_buffer_pool)) {
+            for (const auto& buf : bufs) {
+                auto n = buf.size() / m_block_size;
+                IBlockDevice::read_blocks(lclosed_interval<uint64_t>{ .min = lba, .max = lba + n }, buf.data());
+                lba += n;
             }
+            return;
+        }
+
+        auto iov = make_iovecs(bufs, m_block_size);
+        auto offset = static_cast<off64_t>(lba * m_block_size);
 
-            auto actual_size = ::read(m_fd, buf, expected_size);
+        for (size_t i = 0; i < iov.size();) {
+            auto iov_cnt = static_cast<int>(std::min<size_t>(iov.size() - i, IOV_MAX));
+
+            auto actual_size = ::preadv64(m_fd, iov.data() + i, iov_cnt, offset);
             if (actual_size < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
                 throw std::system_error(errno, std::generic_category());
             } else if (actual_size == 0) {
                 throw std::runtime_error("Read end of device.");
-            } else if (actual_size != expected_size) {
-                throw std::runtime_error("Some blocks are not read.");
             }
+
+            offset += actual_size;
+            i = advance_iovecs(iov, i, static_cast<size_t>(actual_size));
         }
     }
 
-    void UnixBlockDevice::write_blocks(uint64_t lba, uint32_t n, const void* buf) {
-        if (0 < n) {
-            size_t expected_size = n * m_block_size;
-
-            if (::lseek64(m_fd, lba * m_block_size, SEEK_SET) < 0) {
-                throw std::system_error(errno, std::generic_category());
+    void UnixBlockDevice::writev_blocks(uint64_t lba, std::span<const std::span<const std::byte>> bufs) {
+        if (m_aligned_buffer_pool && !all_aligned(bufs, *m_aligned_buffer_pool)) {
+            for (const auto& buf : bufs) {
+                auto n = buf.size() / m_block_size;
+                IBlockDevice::write_blocks(lclosed_interval<uint64_t>{ .min = lba, .max = lba + n }, buf.data());
+                lba += n;
             }
+            return;
+        }
 
-            auto actual_size = ::write(m_fd, buf, expected_size);
+        auto iov = make_iovecs(bufs, m_block_size);
+        auto offset = static_cast<off64_t>(lba * m_block_size);
+
+        for (size_t i = 0; i < iov.size();) {
+            auto iov_cnt = static_cast<int>(std::min<size_t>(iov.size() - i, IOV_MAX));
+
+            auto actual_size = ::pwritev64(m_fd, iov.data() + i, iov_cnt, offset);
             if (actual_size < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
                 throw std::system_error(errno, std::generic_category());
-            } else if (actual_size != expected_size) {
+            } else if (actual_size == 0) {
                 throw std::runtime_error("Some blocks are not written.");
             }
+
+            offset += actual_size;
+            i = advance_iovecs(iov, i, static_cast<size_t>(actual_size));
+        }
+    }
+
+    void UnixBlockDevice::flush() {
+        while (::fdatasync(m_fd) < 0) {
+            if (errno != EINTR) {
+                throw std::system_error(errno, std::generic_category());
+            }
         }
     }
 
@@ -57,20 +235,63 @@ namespace vmgs {
         }
     }
 
-    UnixBlockDevice UnixBlockDevice::open(std::string_view path, bool wrtiable) {
+    UnixBlockDevice UnixBlockDevice::open(std::string_view path, bool wrtiable, size_t image_block_size, bool direct) {
         UnixBlockDevice retval;
 
-        retval.m_fd = ::open(path.data(), wrtiable ? O_RDWR : O_RDONLY);
+        retval.m_fd = ::open(path.data(), (wrtiable ? O_RDWR : O_RDONLY) | (direct ? O_DIRECT : 0) | O_CLOEXEC);
         if (retval.m_fd < 0) {
             throw std::system_error(errno, std::generic_category());
         }
 
-        if (::ioctl(retval.m_fd, BLKSSZGET, &retval.m_block_size) < 0) {
+        struct stat64 st;
+        if (::fstat64(retval.m_fd, &st) < 0) {
             throw std::system_error(errno, std::generic_category());
         }
 
-        if (::ioctl(retval.m_fd, BLKGETSIZE64, &retval.m_device_size) < 0) {
-            throw std::system_error(errno, std::generic_category());
+        size_t memory_alignment;
+
+        if (S_ISBLK(st.st_mode)) {
+            if (::ioctl(retval.m_fd, BLKSSZGET, &retval.m_block_size) < 0) {
+                throw std::system_error(errno, std::generic_category());
+            }
+
+            if (::ioctl(retval.m_fd, BLKGETSIZE64, &retval.m_device_size) < 0) {
+                throw std::system_error(errno, std::generic_category());
+            }
+
+            memory_alignment = retval.m_block_size;
+        } else if (S_ISREG(st.st_mode)) {
+            if (image_block_size == 0 || std::numeric_limits<uint32_t>::max() < image_block_size) {
+                throw std::invalid_argument("Bad image block size.");
+            }
+
+            retval.m_block_size = static_cast<uint32_t>(image_block_size);
+            retval.m_device_size = static_cast<uint64_t>(st.st_size);
+
+            memory_alignment = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#if defined(STATX_DIOALIGN)
+            if (direct) {
+                struct statx stx;
+                if (::statx(retval.m_fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 && (stx.stx_mask & STATX_DIOALIGN)) {
+                    if (stx.stx_dio_offset_align == 0) {
+                        throw std::system_error(EINVAL, std::generic_category());   // O_DIRECT is not supported by the file
+                    }
+
+                    if (retval.m_block_size % stx.stx_dio_offset_align != 0) {
+                        throw std::invalid_argument("Image block size is not a multiple of the file's direct I/O alignment.");
+                    }
+
+                    memory_alignment = stx.stx_dio_mem_align;
+                }
+            }
+#endif
+        } else {
+            throw std::system_error(ENODEV, std::generic_category());
+        }
+
+        if (direct) {
+            retval.m_aligned_buffer_pool =
+                std::make_unique<AlignedBufferPool>(ALIGNED_BUFFER_SIZE_IN_BLOCKS * retval.m_block_size, memory_alignment);
         }
 
         return retval;
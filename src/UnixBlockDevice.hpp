@@ -1,24 +1,39 @@
 #pragma once
+#include <memory>
 #include <string>
 #include <utility>
 
 #include "IBlockDevice.hpp"
+#include "AlignedBufferPool.hpp"
 
 namespace vmgs {
     class UnixBlockDevice : public IBlockDevice {
+    public:
+        // used for regular files, which carry no logical block size of their own
+        static constexpr size_t DEFAULT_IMAGE_BLOCK_SIZE = 512;
+
+        // size of each bounce buffer used for unaligned buffers in O_DIRECT mode
+        static constexpr size_t ALIGNED_BUFFER_SIZE_IN_BLOCKS = 128;
+
     private:
         int m_fd;
         uint32_t m_block_size;
         uint64_t m_device_size;
+        std::unique_ptr<AlignedBufferPool> m_aligned_buffer_pool;  // only present in O_DIRECT mode
 
         UnixBlockDevice() noexcept
-            : m_fd(-1), m_block_size{}, m_device_size{} {}
+            : m_fd(-1), m_block_size{}, m_device_size{}, m_aligned_buffer_pool{} {}
+
+        void read_blocks_direct(uint64_t lba, uint32_t n, void* buf);
+
+        void write_blocks_direct(uint64_t lba, uint32_t n, const void* buf);
 
     public:
         UnixBlockDevice(UnixBlockDevice&& other) noexcept :
             m_fd{ std::exchange(other.m_fd, -1) },
             m_block_size{ std::exchange(other.m_block_size, 0) },
-            m_device_size{ std::exchange(other.m_device_size, 0) } {}
+            m_device_size{ std::exchange(other.m_device_size, 0) },
+            m_aligned_buffer_pool{ std::move(other.m_aligned_buffer_pool) } {}
 
         UnixBlockDevice(const UnixBlockDevice& other) = delete;
 
@@ -30,12 +45,23 @@ namespace vmgs {
             m_fd = std::exchange(other.m_fd, -1);
             m_block_size = std::exchange(other.m_block_size, 0);
             m_device_size = std::exchange(other.m_device_size, 0);
+            m_aligned_buffer_pool = std::move(other.m_aligned_buffer_pool);
 
             return *this;
         }
 
         UnixBlockDevice& operator=(const UnixBlockDevice& other) = delete;
 
+        [[nodiscard]]
+        int native_handle() const noexcept {
+            return m_fd;
+        }
+
+        [[nodiscard]]
+        bool is_direct() const noexcept {
+            return m_aligned_buffer_pool != nullptr;
+        }
+
         [[nodiscard]]
         virtual size_t get_block_size() const override {
             return m_block_size;
@@ -46,13 +72,23 @@ namespace vmgs {
             return m_device_size / m_block_size;
         }
 
+        // All I/O is positional (pread/pwrite family), so one opened device can serve concurrent callers.
         virtual void read_blocks(uint64_t lba, uint32_t n, void* buf) override;
 
         virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override;
 
+        virtual void readv_blocks(uint64_t lba, std::span<const std::span<std::byte>> bufs) override;
+
+        virtual void writev_blocks(uint64_t lba, std::span<const std::span<const std::byte>> bufs) override;
+
+        virtual void flush() override;
+
         void close();
 
+        // `path` may be a block device or a regular image file. For the latter, the size comes from `fstat` and
+        // `image_block_size` is used as the logical block size.
+        // With `direct`, the device is opened with O_DIRECT; unaligned caller buffers go through pooled bounce buffers.
         [[nodiscard]]
-        static UnixBlockDevice open(std::string_view path, bool wrtiable);
+        static UnixBlockDevice open(std::string_view path, bool wrtiable, size_t image_block_size = DEFAULT_IMAGE_BLOCK_SIZE, bool direct = false);
     };
 }
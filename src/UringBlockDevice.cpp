@@ -0,0 +1,365 @@
+#include "UringBlockDevice.hpp"
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+#include <system_error>
+
+namespace vmgs {
+    namespace {
+        // a single SQE never transfers more than this, longer requests are split by the short-transfer path
+        constexpr size_t MAX_TRANSFER_SIZE = 1u << 30;
+
+        [[nodiscard]]
+        uint32_t load_acquire(const uint32_t* p) noexcept {
+            return std::atomic_ref<const uint32_t>{ *p }.load(std::memory_order_acquire);
+        }
+
+        void store_release(uint32_t* p, uint32_t v) noexcept {
+            std::atomic_ref<uint32_t>{ *p }.store(v, std::memory_order_release);
+        }
+    }
+
+    struct UringBlockDevice::Ring {
+        struct Request {
+            uint64_t tag;
+            uint8_t opcode;
+            std::byte* buf;
+            size_t remaining_size;
+            uint64_t offset;
+        };
+
+        int fd = -1;
+        int device_fd = -1;
+
+        void* sq_ring_ptr = MAP_FAILED;
+        size_t sq_ring_size = 0;
+        void* cq_ring_ptr = MAP_FAILED;
+        size_t cq_ring_size = 0;
+        void* sqes_ptr = MAP_FAILED;
+        size_t sqes_size = 0;
+
+        uint32_t* sq_head = nullptr;
+        uint32_t* sq_tail = nullptr;
+        uint32_t* sq_array = nullptr;
+        uint32_t sq_mask = 0;
+        uint32_t sq_entries = 0;
+        io_uring_sqe* sqes = nullptr;
+
+        uint32_t* cq_head = nullptr;
+        uint32_t* cq_tail = nullptr;
+        uint32_t cq_mask = 0;
+        io_uring_cqe* cqes = nullptr;
+
+        uint32_t unsubmitted = 0;
+        std::vector<Request> requests;
+        std::vector<uint32_t> free_requests;
+
+        Ring() noexcept = default;
+
+        Ring(const Ring&) = delete;
+
+        ~Ring() noexcept {
+            if (sqes_ptr != MAP_FAILED) {
+                ::munmap(sqes_ptr, sqes_size);
+            }
+            if (cq_ring_ptr != MAP_FAILED && cq_ring_ptr != sq_ring_ptr) {
+                ::munmap(cq_ring_ptr, cq_ring_size);
+            }
+            if (sq_ring_ptr != MAP_FAILED) {
+                ::munmap(sq_ring_ptr, sq_ring_size);
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+
+        // returns the number of consumed submissions
+        uint32_t enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+            for (;;) {
+                auto ret = ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+                if (ret < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::system_error(errno, std::generic_category());
+                }
+
+                unsubmitted -= static_cast<uint32_t>(ret);
+                return static_cast<uint32_t>(ret);
+            }
+        }
+
+        void push(uint32_t index) {
+            auto tail = *sq_tail;
+
+            if (tail - load_acquire(sq_head) == sq_entries) {
+                enter(unsubmitted, 0, 0);
+                if (tail - load_acquire(sq_head) == sq_entries) {
+                    throw std::runtime_error("io_uring submission queue is full.");
+                }
+            }
+
+            const auto& request = requests[index];
+            auto& sqe = sqes[tail & sq_mask];
+
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = request.opcode;
+            sqe.fd = device_fd;
+            sqe.addr = reinterpret_cast<uintptr_t>(request.buf);
+            sqe.len = static_cast<uint32_t>(std::min(request.remaining_size, MAX_TRANSFER_SIZE));
+            sqe.off = request.offset;
+            sqe.user_data = index;
+
+            sq_array[tail & sq_mask] = tail & sq_mask;
+            store_release(sq_tail, tail + 1);
+
+            ++unsubmitted;
+        }
+    };
+
+    UringBlockDevice::UringBlockDevice(UnixBlockDevice&& device, std::unique_ptr<Ring>&& ring) noexcept
+        : m_device{ std::move(device) }, m_ring{ std::move(ring) } {}
+
+    UringBlockDevice::UringBlockDevice(UringBlockDevice&& other) noexcept
+        : m_device{ std::move(other.m_device) }, m_ring{ std::move(other.m_ring) } {}
+
+    UringBlockDevice::~UringBlockDevice() {
+        close();
+    }
+
+    UringBlockDevice& UringBlockDevice::operator=(UringBlockDevice&& other) noexcept(noexcept(this->close())) {
+        this->close();
+
+        m_device = std::move(other.m_device);
+        m_ring = std::move(other.m_ring);
+
+        return *this;
+    }
+
+    uint32_t UringBlockDevice::get_queue_depth() const noexcept {
+        return m_ring ? m_ring->sq_entries : 0;
+    }
+
+    uint32_t UringBlockDevice::get_inflight_count() const noexcept {
+        return m_ring ? static_cast<uint32_t>(m_ring->requests.size() - m_ring->free_requests.size()) : 0;
+    }
+
+    void UringBlockDevice::queue_request(uint8_t opcode, uint64_t lba, uint32_t n, void* buf, uint64_t tag) {
+        if (!m_ring) {
+            throw std::runtime_error("Device is closed.");
+        }
+
+        if (m_ring->free_requests.empty()) {
+            throw std::runtime_error("Too many inflight requests, reap completions first.");
+        }
+
+        auto index = m_ring->free_requests.back();
+
+        m_ring->requests[index] = Ring::Request{
+            .tag = tag,
+            .opcode = opcode,
+            .buf = static_cast<std::byte*>(buf),
+            .remaining_size = static_cast<size_t>(n) * get_block_size(),
+            .offset = lba * get_block_size()
+        };
+
+        m_ring->push(index);
+        m_ring->free_requests.pop_back();
+    }
+
+    void UringBlockDevice::queue_read_blocks(uint64_t lba, uint32_t n, void* buf, uint64_t tag) {
+        queue_request(IORING_OP_READ, lba, n, buf, tag);
+    }
+
+    void UringBlockDevice::queue_write_blocks(uint64_t lba, uint32_t n, const void* buf, uint64_t tag) {
+        queue_request(IORING_OP_WRITE, lba, n, const_cast<void*>(buf), tag);
+    }
+
+    uint32_t UringBlockDevice::submit() {
+        uint32_t submitted = 0;
+
+        if (m_ring) {
+            while (0 < m_ring->unsubmitted) {
+                auto n = m_ring->enter(m_ring->unsubmitted, 0, 0);
+                if (n == 0) {
+                    break;
+                }
+                submitted += n;
+            }
+        }
+
+        return submitted;
+    }
+
+    size_t UringBlockDevice::reap(std::span<BlockIoCompletion> completions, size_t min_complete) {
+        size_t count = 0;
+
+        if (!m_ring) {
+            return count;
+        }
+
+        submit();
+
+        min_complete = std::min(min_complete, completions.size());
+
+        for (;;) {
+            auto head = *m_ring->cq_head;
+            auto tail = load_acquire(m_ring->cq_tail);
+
+            for (; head != tail && count < completions.size(); ++head) {
+                const auto& cqe = m_ring->cqes[head & m_ring->cq_mask];
+
+                auto index = static_cast<uint32_t>(cqe.user_data);
+                auto& request = m_ring->requests[index];
+
+                int error;
+                if (cqe.res < 0) {
+                    error = -cqe.res;
+                    if (error == EINTR || error == EAGAIN) {
+                        m_ring->push(index);
+                        continue;
+                    }
+                } else if (cqe.res == 0) {
+                    error = EIO;    // unexpected end of device
+                } else if (static_cast<size_t>(cqe.res) < request.remaining_size) {
+                    request.buf += cqe.res;
+                    request.offset += cqe.res;
+                    request.remaining_size -= cqe.res;
+                    m_ring->push(index);
+                    continue;
+                } else {
+                    error = 0;
+                }
+
+                completions[count++] = BlockIoCompletion{ .tag = request.tag, .error = error };
+                m_ring->free_requests.push_back(index);
+            }
+
+            store_release(m_ring->cq_head, head);
+
+            if (count >= min_complete || count == completions.size() || get_inflight_count() == 0) {
+                break;
+            }
+
+            m_ring->enter(m_ring->unsubmitted, 1, IORING_ENTER_GETEVENTS);
+        }
+
+        return count;
+    }
+
+    void UringBlockDevice::read_blocks(std::span<const BlockRequest> requests, uint32_t max_gap) {
+        if (!m_ring || get_inflight_count() != 0) {
+            IBlockDevice::read_blocks(requests, max_gap);
+            return;
+        }
+
+        std::vector<BlockIoCompletion> completions(m_ring->requests.size());
+        int error = 0;
+
+        for (size_t i = 0; i < requests.size();) {
+            uint32_t queued = 0;
+            for (; i < requests.size() && !m_ring->free_requests.empty(); ++i) {
+                if (0 < requests[i].n) {
+                    queue_read_blocks(requests[i].lba, requests[i].n, requests[i].buf, i);
+                    ++queued;
+                }
+            }
+
+            if (0 < queued) {
+                m_ring->enter(m_ring->unsubmitted, queued, IORING_ENTER_GETEVENTS);
+            }
+
+            // every request is waited for even after a failure, the kernel may still be writing into their buffers
+            for (uint32_t reaped = 0; reaped < queued;) {
+                auto count = reap(std::span{ completions }.first(queued - reaped), queued - reaped);
+                for (size_t k = 0; k < count; ++k) {
+                    if (error == 0) {
+                        error = completions[k].error;
+                    }
+                }
+                reaped += static_cast<uint32_t>(count);
+            }
+        }
+
+        if (error != 0) {
+            throw std::system_error(error, std::generic_category());
+        }
+    }
+
+    void UringBlockDevice::close() {
+        m_ring.reset();
+        m_device.close();
+    }
+
+    UringBlockDevice UringBlockDevice::open(std::string_view path, bool writable, size_t image_block_size, uint32_t queue_depth) {
+        auto device = UnixBlockDevice::open(path, writable, image_block_size);
+        auto ring = std::make_unique<Ring>();
+
+        io_uring_params params{};
+
+        ring->fd = static_cast<int>(::syscall(__NR_io_uring_setup, queue_depth, &params));
+        if (ring->fd < 0) {
+            throw std::system_error(errno, std::generic_category());
+        }
+
+        ring->device_fd = device.native_handle();
+
+        ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            ring->sq_ring_size = std::max(ring->sq_ring_size, ring->cq_ring_size);
+            ring->cq_ring_size = ring->sq_ring_size;
+        }
+
+        ring->sq_ring_ptr = ::mmap(nullptr, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+        if (ring->sq_ring_ptr == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category());
+        }
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            ring->cq_ring_ptr = ring->sq_ring_ptr;
+        } else {
+            ring->cq_ring_ptr = ::mmap(nullptr, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+            if (ring->cq_ring_ptr == MAP_FAILED) {
+                throw std::system_error(errno, std::generic_category());
+            }
+        }
+
+        ring->sqes_ptr = ::mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+        if (ring->sqes_ptr == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category());
+        }
+
+        auto sq_base = static_cast<std::byte*>(ring->sq_ring_ptr);
+        auto cq_base = static_cast<std::byte*>(ring->cq_ring_ptr);
+
+        ring->sq_head = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.head);
+        ring->sq_tail = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.tail);
+        ring->sq_array = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.array);
+        ring->sq_mask = *reinterpret_cast<uint32_t*>(sq_base + params.sq_off.ring_mask);
+        ring->sq_entries = params.sq_entries;
+        ring->sqes = static_cast<io_uring_sqe*>(ring->sqes_ptr);
+
+        ring->cq_head = reinterpret_cast<uint32_t*>(cq_base + params.cq_off.head);
+        ring->cq_tail = reinterpret_cast<uint32_t*>(cq_base + params.cq_off.tail);
+        ring->cq_mask = *reinterpret_cast<uint32_t*>(cq_base + params.cq_off.ring_mask);
+        ring->cqes = reinterpret_cast<io_uring_cqe*>(cq_base + params.cq_off.cqes);
+
+        // at most `cq_entries` requests can be inflight, so the completion queue never overflows
+        ring->requests.resize(params.cq_entries);
+        ring->free_requests.reserve(params.cq_entries);
+        for (uint32_t i = params.cq_entries; 0 < i; --i) {
+            ring->free_requests.push_back(i - 1);
+        }
+
+        return UringBlockDevice{ std::move(device), std::move(ring) };
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <memory>
+#include <span>
+#include <string>
+#include <utility>
+
+#include "UnixBlockDevice.hpp"
+
+namespace vmgs {
+    struct BlockIoCompletion {
+        uint64_t tag;
+        int error;  // 0 on success, otherwise an errno value
+    };
+
+    // A block device backed by an io_uring instance.
+    //
+    // The synchronous virtuals are served with positional I/O and do not touch the ring, so they can be mixed
+    // freely with the asynchronous API:
+    //   1. `queue_read_blocks` / `queue_write_blocks` put requests into the submission queue;
+    //   2. `submit` hands every queued request to the kernel with a single syscall;
+    //   3. `reap` collects completions, optionally waiting for some of them.
+    // Short transfers are resubmitted internally, so a completion always covers the whole request.
+    // Buffers passed to `queue_*` must stay valid until the corresponding completion is reaped.
+    class UringBlockDevice : public IBlockDevice {
+    public:
+        static constexpr uint32_t DEFAULT_QUEUE_DEPTH = 64;
+
+    private:
+        struct Ring;
+
+        UnixBlockDevice m_device;
+        std::unique_ptr<Ring> m_ring;
+
+        UringBlockDevice(UnixBlockDevice&& device, std::unique_ptr<Ring>&& ring) noexcept;
+
+        void queue_request(uint8_t opcode, uint64_t lba, uint32_t n, void* buf, uint64_t tag);
+
+    public:
+        UringBlockDevice(UringBlockDevice&& other) noexcept;
+
+        UringBlockDevice(const UringBlockDevice& other) = delete;
+
+        virtual ~UringBlockDevice() override;
+
+        UringBlockDevice& operator=(UringBlockDevice&& other) noexcept(noexcept(this->close()));
+
+        UringBlockDevice& operator=(const UringBlockDevice& other) = delete;
+
+        [[nodiscard]]
+        virtual size_t get_block_size() const override {
+            return m_device.get_block_size();
+        }
+
+        [[nodiscard]]
+        virtual uint64_t get_block_count() const override {
+            return m_device.get_block_count();
+        }
+
+        virtual void read_blocks(uint64_t lba, uint32_t n, void* buf) override {
+            m_device.read_blocks(lba, n, buf);
+        }
+
+        virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override {
+            m_device.write_blocks(lba, n, buf);
+        }
+
+        // Queues every request, then submits them and waits for all of them with a single `io_uring_enter` as long as
+        // the queue has room; `max_gap` is not needed. Falls back to the merging read while asynchronous requests are
+        // inflight, whose completions must not be reaped here.
+        virtual void read_blocks(std::span<const BlockRequest> requests, uint32_t max_gap = DEFAULT_COALESCE_GAP) override;
+
+        virtual void readv_blocks(uint64_t lba, std::span<const std::span<std::byte>> bufs) override {
+            m_device.readv_blocks(lba, bufs);
+        }
+
+        virtual void writev_blocks(uint64_t lba, std::span<const std::span<const std::byte>> bufs) override {
+            m_device.writev_blocks(lba, bufs);
+        }
+
+        virtual void flush() override {
+            m_device.flush();
+        }
+
+        [[nodiscard]]
+        uint32_t get_queue_depth() const noexcept;
+
+        // number of requests that have been queued but not reaped yet
+        [[nodiscard]]
+        uint32_t get_inflight_count() const noexcept;
+
+        void queue_read_blocks(uint64_t lba, uint32_t n, void* buf, uint64_t tag);
+
+        void queue_write_blocks(uint64_t lba, uint32_t n, const void* buf, uint64_t tag);
+
+        // returns the number of requests handed to the kernel
+        uint32_t submit();
+
+        // Submits queued requests, then stores up to `completions.size()` completions into `completions`.
+        // Blocks until at least `min_complete` completions are available. Returns the number of stored completions.
+        size_t reap(std::span<BlockIoCompletion> completions, size_t min_complete = 0);
+
+        void close();
+
+        [[nodiscard]]
+        static UringBlockDevice open(
+            std::string_view path,
+            bool writable,
+            size_t image_block_size = UnixBlockDevice::DEFAULT_IMAGE_BLOCK_SIZE,
+            uint32_t queue_depth = DEFAULT_QUEUE_DEPTH
+        );
+    };
+}
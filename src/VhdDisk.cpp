@@ -87,6 +87,39 @@ namespace vmgs {
         }
     }
 
+    void VhdDisk::flush() {
+        DWORD win32_err;
+
+        CDB cdb{};
+        SENSE_DATA sense_data{};
+
+        RAW_SCSI_VIRTUAL_DISK_PARAMETERS scsi_req{};
+        RAW_SCSI_VIRTUAL_DISK_RESPONSE scsi_rsp;
+
+        // zero LBA and zero block count cover the whole disk
+        cdb.SYNCHRONIZE_CACHE10.OperationCode = SCSIOP_SYNCHRONIZE_CACHE;
+
+        scsi_req.Version = RAW_SCSI_VIRTUAL_DISK_VERSION_1;
+        scsi_req.Version1.RSVDHandle = FALSE;
+        scsi_req.Version1.DataIn = 0;
+        scsi_req.Version1.CdbLength = sizeof(cdb.SYNCHRONIZE_CACHE10);
+        scsi_req.Version1.SenseInfoLength = sizeof(sense_data);
+        scsi_req.Version1.SrbFlags = 0;
+        scsi_req.Version1.DataTransferLength = 0;
+        scsi_req.Version1.DataBuffer = NULL;
+        scsi_req.Version1.SenseInfo = reinterpret_cast<UCHAR*>(&sense_data);
+        scsi_req.Version1.Cdb = reinterpret_cast<UCHAR*>(&cdb);
+
+        win32_err = RawSCSIVirtualDisk(m_handle, &scsi_req, RAW_SCSI_VIRTUAL_DISK_FLAG_NONE, &scsi_rsp);
+        if (win32_err != ERROR_SUCCESS) {
+            throw std::system_error(win32_err, std::system_category());
+        }
+
+        if (scsi_rsp.Version1.ScsiStatus != SCSISTAT_GOOD) {
+            throw std::system_error(ERROR_DEVICE_HARDWARE_ERROR, std::system_category());
+        }
+    }
+
     void VhdDisk::attach() {
         // ATTACH_VIRTUAL_DISK_FLAG_NO_LOCAL_HOST is needed for RawSCSIVirtualDisk
         auto win32_err = AttachVirtualDisk(m_handle, NULL, ATTACH_VIRTUAL_DISK_FLAG_NO_LOCAL_HOST, 0, NULL, NULL);
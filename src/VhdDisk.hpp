@@ -72,6 +72,10 @@ namespace vmgs {
 
         virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override;
 
+        // Writes go to the virtual disk as SCSI commands, so they are made durable with SYNCHRONIZE CACHE on the same
+        // path rather than with `FlushFileBuffers`.
+        virtual void flush() override;
+
         void detach();
 
         void close();
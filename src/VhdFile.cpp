@@ -0,0 +1,495 @@
+#include "VhdFile.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+#include "endian_storage.hpp"
+#include "Gpt.hpp"
+
+namespace vmgs {
+    constexpr std::array<std::byte, 8> VHD_FOOTER_COOKIE =
+        { std::byte{'c'}, std::byte{'o'}, std::byte{'n'}, std::byte{'e'},
+          std::byte{'c'}, std::byte{'t'}, std::byte{'i'}, std::byte{'x'} };
+
+    constexpr std::array<std::byte, 8> VHD_DYNAMIC_HEADER_COOKIE =
+        { std::byte{'c'}, std::byte{'x'}, std::byte{'s'}, std::byte{'p'},
+          std::byte{'a'}, std::byte{'r'}, std::byte{'s'}, std::byte{'e'} };
+
+    // platform codes of parent locators that hold UTF-16LE Windows paths
+    constexpr uint32_t VHD_PLATFORM_CODE_W2RU = 0x57327275;     // 'W2ru', relative path
+    constexpr uint32_t VHD_PLATFORM_CODE_W2KU = 0x57326b75;     // 'W2ku', absolute path
+
+    constexpr uint32_t VHD_FILE_FORMAT_VERSION = 0x00010000;
+    constexpr uint32_t VHD_DYNAMIC_HEADER_VERSION = 0x00010000;
+
+    struct VhdFooterLayout {
+        std::array<std::byte, 8> cookie;
+        std::array<std::byte, 4> features;
+        std::array<std::byte, 4> file_format_version;
+        std::array<std::byte, 8> data_offset;
+        std::array<std::byte, 4> time_stamp;
+        std::array<std::byte, 4> creator_application;
+        std::array<std::byte, 4> creator_version;
+        std::array<std::byte, 4> creator_host_os;
+        std::array<std::byte, 8> original_size;
+        std::array<std::byte, 8> current_size;
+        std::array<std::byte, 4> disk_geometry;
+        std::array<std::byte, 4> disk_type;
+        std::array<std::byte, 4> checksum;
+        std::array<std::byte, 16> unique_id;
+        std::array<std::byte, 1> saved_state;
+        std::array<std::byte, 427> reserved;
+    };
+
+    static_assert(sizeof(VhdFooterLayout) == 512);
+    static_assert(alignof(VhdFooterLayout) == alignof(std::byte));
+
+    struct VhdParentLocatorLayout {
+        std::array<std::byte, 4> platform_code;
+        std::array<std::byte, 4> platform_data_space;
+        std::array<std::byte, 4> platform_data_length;
+        std::array<std::byte, 4> reserved;
+        std::array<std::byte, 8> platform_data_offset;
+    };
+
+    static_assert(sizeof(VhdParentLocatorLayout) == 24);
+
+    struct VhdDynamicHeaderLayout {
+        std::array<std::byte, 8> cookie;
+        std::array<std::byte, 8> data_offset;
+        std::array<std::byte, 8> table_offset;
+        std::array<std::byte, 4> header_version;
+        std::array<std::byte, 4> max_table_entries;
+        std::array<std::byte, 4> block_size;
+        std::array<std::byte, 4> checksum;
+        std::array<std::byte, 16> parent_unique_id;
+        std::array<std::byte, 4> parent_time_stamp;
+        std::array<std::byte, 4> reserved;
+        std::array<std::byte, 512> parent_unicode_name;
+        std::array<VhdParentLocatorLayout, 8> parent_locators;
+        std::array<std::byte, 256> reserved2;
+    };
+
+    static_assert(sizeof(VhdDynamicHeaderLayout) == 1024);
+    static_assert(alignof(VhdDynamicHeaderLayout) == alignof(std::byte));
+
+    namespace {
+        // one's complement of the byte sum, with the 4-byte checksum field at `checksum_offset` taken as zero
+        [[nodiscard]]
+        uint32_t vhd_checksum(const void* data, size_t size, size_t checksum_offset) noexcept {
+            auto p = reinterpret_cast<const uint8_t*>(data);
+            uint32_t sum = std::accumulate(p, p + checksum_offset, uint32_t{ 0 });
+            sum = std::accumulate(p + checksum_offset + 4, p + size, sum);
+            return ~sum;
+        }
+
+        [[nodiscard]]
+        bool is_valid_footer(const VhdFooterLayout& footer) noexcept {
+            return footer.cookie == VHD_FOOTER_COOKIE &&
+                endian_load<uint32_t, std::endian::big>(footer.checksum) == vhd_checksum(&footer, sizeof(VhdFooterLayout), offsetof(VhdFooterLayout, checksum));
+        }
+
+        [[nodiscard]]
+        std::vector<std::byte> read_sectors(IBlockDevice& file, uint64_t offset, size_t size) {
+            if (offset % VhdFile::SECTOR_SIZE != 0 || size % VhdFile::SECTOR_SIZE != 0) {
+                throw std::runtime_error(std::format("Bad VHD: Structure at offset 0x{:x} is not sector-aligned.", offset));
+            }
+
+            if (file.get_block_count() < (offset + size) / VhdFile::SECTOR_SIZE) {
+                throw std::runtime_error(std::format("Bad VHD: Structure at offset 0x{:x} exceeds end of file.", offset));
+            }
+
+            std::vector<std::byte> retval(size);
+            file.read_blocks(lclosed_interval<uint64_t>{ .min = offset / VhdFile::SECTOR_SIZE, .max = (offset + size) / VhdFile::SECTOR_SIZE }, retval.data());
+            return retval;
+        }
+
+        [[nodiscard]]
+        std::string load_guid_text(const std::array<std::byte, 16>& bytes) {
+            GptGuid guid;
+            guid.data1 = endian_load<uint32_t, std::endian::big>(std::span<const std::byte, 4>{ bytes.data(), 4 });
+            guid.data2 = endian_load<uint16_t, std::endian::big>(std::span<const std::byte, 2>{ bytes.data() + 4, 2 });
+            guid.data3 = endian_load<uint16_t, std::endian::big>(std::span<const std::byte, 2>{ bytes.data() + 6, 2 });
+            std::ranges::transform(bytes.begin() + 8, bytes.end(), guid.data4.begin(), [](auto v) { return std::to_integer<uint8_t>(v); });
+            return std::format("{:x}", guid);
+        }
+
+        void write_sectors(IBlockDevice& file, uint64_t offset, std::span<const std::byte> data) {
+            file.write_blocks(lclosed_interval<uint64_t>{ .min = offset / VhdFile::SECTOR_SIZE, .max = (offset + data.size()) / VhdFile::SECTOR_SIZE }, data.data());
+        }
+    }
+
+    std::vector<uint8_t>& VhdFile::load_sector_bitmap(uint32_t block_index) {
+        auto iter = m_sector_bitmaps.find(block_index);
+        if (iter == m_sector_bitmaps.end()) {
+            auto bytes = read_sectors(*m_file, uint64_t{ m_bat[block_index] } * SECTOR_SIZE, sector_bitmap_size());
+
+            std::vector<uint8_t> bitmap(bytes.size());
+            std::ranges::transform(bytes, bitmap.begin(), [](auto v) { return std::to_integer<uint8_t>(v); });
+
+            iter = m_sector_bitmaps.emplace(block_index, std::move(bitmap)).first;
+        }
+        return iter->second;
+    }
+
+    std::vector<VhdExtent> VhdFile::map_extents(uint64_t lba, uint64_t n) {
+        if (get_block_count() < lba || get_block_count() - lba < n) {
+            throw std::out_of_range(std::format("VHD access out of range: [0x{:x}, 0x{:x}).", lba, lba + n));
+        }
+
+        std::vector<VhdExtent> extents;
+
+        auto append = [&extents](const VhdExtent& extent) {
+            if (!extents.empty() && extents.back().present == extent.present &&
+                (!extent.present || extents.back().file_offset + extents.back().length == extent.file_offset))
+            {
+                extents.back().length += extent.length;
+            } else {
+                extents.push_back(extent);
+            }
+        };
+
+        if (m_disk_type == VhdDiskType::fixed) {
+            if (0 < n) {
+                append(VhdExtent{ .present = true, .file_offset = lba * SECTOR_SIZE, .length = n * SECTOR_SIZE });
+            }
+            return extents;
+        }
+
+        uint64_t sectors_per_block = m_data_block_size / SECTOR_SIZE;
+
+        while (0 < n) {
+            auto block_index = static_cast<uint32_t>(lba / sectors_per_block);
+            uint64_t sector_index = lba % sectors_per_block;
+            uint64_t count = std::min<uint64_t>(n, sectors_per_block - sector_index);
+
+            if (m_bat[block_index] == UNUSED_BAT_ENTRY) {
+                append(VhdExtent{ .present = false, .file_offset = 0, .length = count * SECTOR_SIZE });
+            } else {
+                const auto& bitmap = load_sector_bitmap(block_index);
+                uint64_t data_offset = uint64_t{ m_bat[block_index] } * SECTOR_SIZE + sector_bitmap_size();
+
+                // the most significant bit of each bitmap byte is the first sector
+                for (uint64_t i = sector_index; i < sector_index + count; ++i) {
+                    bool present = (bitmap[i / 8] >> (7 - i % 8)) & 1;
+                    append(VhdExtent{ .present = present, .file_offset = present ? data_offset + i * SECTOR_SIZE : 0, .length = SECTOR_SIZE });
+                }
+            }
+
+            lba += count;
+            n -= count;
+        }
+
+        return extents;
+    }
+
+    std::vector<VirtualDiskRun> VhdFile::map_runs(uint64_t lba, uint64_t n) {
+        std::vector<VirtualDiskRun> runs;
+        if (m_disk_type != VhdDiskType::differencing) {
+            if (0 < n) {
+                runs.push_back(VirtualDiskRun{ .n = n, .inherited = false });
+            }
+            return runs;
+        }
+
+        for (const auto& extent : map_extents(lba, n)) {
+            if (!runs.empty() && runs.back().inherited == !extent.present) {
+                runs.back().n += extent.length / SECTOR_SIZE;
+            } else {
+                runs.push_back(VirtualDiskRun{ .n = extent.length / SECTOR_SIZE, .inherited = !extent.present });
+            }
+        }
+
+        return runs;
+    }
+
+    std::string VhdFile::get_linkage_id() const {
+        return load_guid_text(reinterpret_cast<const VhdFooterLayout*>(m_footer.data())->unique_id);
+    }
+
+    void VhdFile::read_blocks(uint64_t lba, uint32_t n, void* buf) {
+        std::vector<BlockRequest> requests;
+
+        auto p = static_cast<std::byte*>(buf);
+        for (const auto& extent : map_extents(lba, n)) {
+            if (extent.present) {
+                // an extent never exceeds the request, which is at most `n` sectors
+                requests.push_back(
+                    BlockRequest{ .lba = extent.file_offset / SECTOR_SIZE, .n = static_cast<uint32_t>(extent.length / SECTOR_SIZE), .buf = p }
+                );
+            } else {
+                memset(p, 0, extent.length);
+            }
+            p += extent.length;
+        }
+
+        m_file->read_blocks(requests);
+    }
+
+    uint32_t VhdFile::allocate_data_block(uint32_t block_index) {
+        uint64_t block_sector = m_footer_offset / SECTOR_SIZE;
+        uint64_t new_footer_offset = m_footer_offset + sector_bitmap_size() + m_data_block_size;
+
+        if (std::numeric_limits<uint32_t>::max() <= block_sector) {
+            throw std::runtime_error("VHD file is too large.");
+        }
+
+        // An empty sector bitmap replaces the footer, which moves to the new end of the file; data sectors in between
+        // are past the old end of the file and read as zeros.
+        std::vector<std::byte> bitmap(sector_bitmap_size());
+        write_sectors(*m_file, m_footer_offset, bitmap);
+        write_sectors(*m_file, new_footer_offset, m_footer);
+        m_file->flush();
+
+        m_footer_offset = new_footer_offset;
+        m_bat[block_index] = static_cast<uint32_t>(block_sector);
+        m_sector_bitmaps.insert_or_assign(block_index, std::vector<uint8_t>(bitmap.size()));
+
+        // the BAT entry goes last, so an interrupted allocation only leaves an unreferenced block behind
+        uint64_t entry_offset = m_bat_offset + uint64_t{ block_index } * 4;
+        uint64_t sector_offset = entry_offset - entry_offset % SECTOR_SIZE;
+
+        auto sector = read_sectors(*m_file, sector_offset, SECTOR_SIZE);
+        endian_store<uint32_t, std::endian::big>(std::span<std::byte, 4>{ sector.data() + (entry_offset - sector_offset), 4 }, m_bat[block_index]);
+        write_sectors(*m_file, sector_offset, sector);
+
+        return m_bat[block_index];
+    }
+
+    void VhdFile::write_blocks(uint64_t lba, uint32_t n, const void* buf) {
+        if (!m_writable) {
+            throw std::runtime_error("VHD is opened read-only.");
+        }
+
+        if (get_block_count() < lba || get_block_count() - lba < n) {
+            throw std::out_of_range(std::format("VHD access out of range: [0x{:x}, 0x{:x}).", lba, lba + n));
+        }
+
+        if (m_disk_type == VhdDiskType::fixed) {
+            m_file->write_blocks(lba, n, buf);
+            return;
+        }
+
+        uint64_t sectors_per_block = m_data_block_size / SECTOR_SIZE;
+
+        auto p = static_cast<const std::byte*>(buf);
+        while (0 < n) {
+            auto block_index = static_cast<uint32_t>(lba / sectors_per_block);
+            uint64_t sector_index = lba % sectors_per_block;
+            auto count = static_cast<uint32_t>(std::min<uint64_t>(n, sectors_per_block - sector_index));
+
+            uint32_t block_sector = m_bat[block_index] == UNUSED_BAT_ENTRY ? allocate_data_block(block_index) : m_bat[block_index];
+            uint64_t data_offset = uint64_t{ block_sector } * SECTOR_SIZE + sector_bitmap_size();
+
+            m_file->write_blocks(data_offset / SECTOR_SIZE + sector_index, count, p);
+
+            // sectors become present only after their data is written
+            auto& bitmap = load_sector_bitmap(block_index);
+            bool bitmap_changed = false;
+            for (uint64_t i = sector_index; i < sector_index + count; ++i) {
+                uint8_t mask = 0x80 >> (i % 8);
+                if ((bitmap[i / 8] & mask) == 0) {
+                    bitmap[i / 8] |= mask;
+                    bitmap_changed = true;
+                }
+            }
+
+            if (bitmap_changed) {
+                std::vector<std::byte> bytes(bitmap.size());
+                std::ranges::transform(bitmap, bytes.begin(), [](auto v) { return std::byte{ v }; });
+                write_sectors(*m_file, uint64_t{ block_sector } * SECTOR_SIZE, bytes);
+            }
+
+            lba += count;
+            n -= count;
+            p += static_cast<size_t>(count) * SECTOR_SIZE;
+        }
+    }
+
+    bool VhdFile::probe(IBlockDevice& file) {
+        if (file.get_block_size() != SECTOR_SIZE || file.get_block_count() == 0) {
+            return false;
+        }
+
+        auto footer = read_sectors(file, (file.get_block_count() - 1) * SECTOR_SIZE, SECTOR_SIZE);
+        return reinterpret_cast<const VhdFooterLayout*>(footer.data())->cookie == VHD_FOOTER_COOKIE;
+    }
+
+    VhdFile VhdFile::open(std::unique_ptr<IBlockDevice>&& file, bool writable) {
+        VhdFile retval;
+
+        if (file->get_block_size() != SECTOR_SIZE) {
+            throw std::runtime_error("Bad VHD: Block size of the file must be 512 bytes.");
+        }
+
+        if (file->get_block_count() < 1) {
+            throw std::runtime_error("Bad VHD: Insufficient data.");
+        }
+
+        // dynamic disks keep a copy of the footer at the beginning of the file
+        retval.m_footer_offset = (file->get_block_count() - 1) * SECTOR_SIZE;
+        retval.m_footer = read_sectors(*file, retval.m_footer_offset, SECTOR_SIZE);
+
+        if (!is_valid_footer(*reinterpret_cast<const VhdFooterLayout*>(retval.m_footer.data()))) {
+            auto footer_copy = read_sectors(*file, 0, SECTOR_SIZE);
+            if (!is_valid_footer(*reinterpret_cast<const VhdFooterLayout*>(footer_copy.data()))) {
+                throw std::runtime_error("Bad VHD: No valid footer.");
+            }
+            retval.m_footer = std::move(footer_copy);
+        }
+
+        auto footer = reinterpret_cast<const VhdFooterLayout*>(retval.m_footer.data());
+
+        {
+            uint32_t version = endian_load<uint32_t, std::endian::big>(footer->file_format_version);
+            if (version != VHD_FILE_FORMAT_VERSION) {
+                throw std::runtime_error(std::format("Bad VHD footer: Unexpected `file_format_version`, expect 0x{:08x}, but got 0x{:08x}.", VHD_FILE_FORMAT_VERSION, version));
+            }
+        }
+
+        retval.m_writable = writable;
+        retval.m_disk_type = static_cast<VhdDiskType>(endian_load<uint32_t, std::endian::big>(footer->disk_type));
+        retval.m_virtual_size = endian_load<uint64_t, std::endian::big>(footer->current_size);
+
+        if (retval.m_virtual_size % SECTOR_SIZE != 0) {
+            throw std::runtime_error("Bad VHD footer: `current_size` is not a multiple of sector size.");
+        }
+
+        switch (retval.m_disk_type) {
+            case VhdDiskType::fixed:
+                if (retval.m_footer_offset < retval.m_virtual_size) {
+                    throw std::runtime_error("Bad VHD: File is smaller than the disk.");
+                }
+                break;
+            case VhdDiskType::dynamic:
+            case VhdDiskType::differencing: {
+                if (retval.m_disk_type == VhdDiskType::differencing && writable) {
+                    throw std::runtime_error("Differencing VHD can only be opened read-only.");
+                }
+
+                uint64_t header_offset = endian_load<uint64_t, std::endian::big>(footer->data_offset);
+
+                auto header_bytes = read_sectors(*file, header_offset, sizeof(VhdDynamicHeaderLayout));
+                auto header = reinterpret_cast<const VhdDynamicHeaderLayout*>(header_bytes.data());
+
+                if (!(header->cookie == VHD_DYNAMIC_HEADER_COOKIE)) {
+                    throw std::runtime_error("Bad VHD dynamic header: Invalid cookie.");
+                }
+
+                {
+                    uint32_t checksum = endian_load<uint32_t, std::endian::big>(header->checksum);
+                    uint32_t expected = vhd_checksum(header, sizeof(VhdDynamicHeaderLayout), offsetof(VhdDynamicHeaderLayout, checksum));
+                    if (checksum != expected) {
+                        throw std::runtime_error(std::format("Bad VHD dynamic header: Invalid checksum, expect 0x{:08x}, but got 0x{:08x}.", expected, checksum));
+                    }
+                }
+
+                {
+                    uint32_t version = endian_load<uint32_t, std::endian::big>(header->header_version);
+                    if (version != VHD_DYNAMIC_HEADER_VERSION) {
+                        throw std::runtime_error(std::format("Bad VHD dynamic header: Unexpected `header_version`, expect 0x{:08x}, but got 0x{:08x}.", VHD_DYNAMIC_HEADER_VERSION, version));
+                    }
+                }
+
+                retval.m_data_block_size = endian_load<uint32_t, std::endian::big>(header->block_size);
+                if (!std::has_single_bit(retval.m_data_block_size) || retval.m_data_block_size < SECTOR_SIZE * 8) {
+                    throw std::runtime_error(std::format("Bad VHD dynamic header: Invalid block size 0x{:x}.", retval.m_data_block_size));
+                }
+
+                uint32_t max_table_entries = endian_load<uint32_t, std::endian::big>(header->max_table_entries);
+                if (max_table_entries < (retval.m_virtual_size + retval.m_data_block_size - 1) / retval.m_data_block_size) {
+                    throw std::runtime_error("Bad VHD dynamic header: `max_table_entries` does not cover the disk.");
+                }
+
+                retval.m_bat_offset = endian_load<uint64_t, std::endian::big>(header->table_offset);
+
+                uint64_t bat_size = (uint64_t{ max_table_entries } * 4 + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+                auto bat_bytes = read_sectors(*file, retval.m_bat_offset, bat_size);
+
+                retval.m_bat.resize(max_table_entries);
+                for (uint32_t i = 0; i < max_table_entries; ++i) {
+                    retval.m_bat[i] = endian_load<uint32_t, std::endian::big>(std::span<const std::byte, 4>{ bat_bytes.data() + uint64_t{ i } * 4, 4 });
+                    if (retval.m_bat[i] != UNUSED_BAT_ENTRY && retval.m_footer_offset / SECTOR_SIZE < retval.m_bat[i] + (retval.sector_bitmap_size() + retval.m_data_block_size) / SECTOR_SIZE) {
+                        throw std::runtime_error(std::format("Bad VHD BAT: Data block {} exceeds end of file.", i));
+                    }
+                }
+
+                if (retval.m_disk_type == VhdDiskType::differencing) {
+                    VirtualDiskParent parent{ .linkage_id = load_guid_text(header->parent_unique_id), .paths = {} };
+
+                    std::u16string relative_path;
+                    std::u16string absolute_path;
+                    for (const auto& locator : header->parent_locators) {
+                        uint32_t platform_code = endian_load<uint32_t, std::endian::big>(locator.platform_code);
+                        if (platform_code != VHD_PLATFORM_CODE_W2RU && platform_code != VHD_PLATFORM_CODE_W2KU) {
+                            continue;
+                        }
+
+                        uint64_t data_offset = endian_load<uint64_t, std::endian::big>(locator.platform_data_offset);
+                        uint32_t data_length = endian_load<uint32_t, std::endian::big>(locator.platform_data_length);
+                        uint32_t data_space = endian_load<uint32_t, std::endian::big>(locator.platform_data_space);
+
+                        // `platform_data_space` is in sectors by the spec, but some writers store bytes
+                        if (data_space < SECTOR_SIZE) {
+                            data_space *= SECTOR_SIZE;
+                        }
+
+                        if (data_space < data_length || data_length % 2 != 0) {
+                            throw std::runtime_error("Bad VHD dynamic header: Invalid parent locator.");
+                        }
+
+                        auto data = read_sectors(*file, data_offset, data_space);
+
+                        std::u16string path(data_length / 2, u'\0');
+                        for (size_t i = 0; i < path.size(); ++i) {
+                            path[i] = endian_load<char16_t, std::endian::little>(std::span<const std::byte, 2>{ data.data() + i * 2, 2 });
+                        }
+
+                        while (!path.empty() && path.back() == u'\0') {
+                            path.pop_back();
+                        }
+
+                        (platform_code == VHD_PLATFORM_CODE_W2RU ? relative_path : absolute_path) = std::move(path);
+                    }
+
+                    // the parent's file name, in UTF-16BE
+                    std::u16string parent_name;
+                    for (size_t i = 0; i < header->parent_unicode_name.size(); i += 2) {
+                        auto c = endian_load<char16_t, std::endian::big>(std::span<const std::byte, 2>{ header->parent_unicode_name.data() + i, 2 });
+                        if (c == u'\0') {
+                            break;
+                        }
+                        parent_name.push_back(c);
+                    }
+
+                    for (auto* path : { &relative_path, &absolute_path, &parent_name }) {
+                        if (!path->empty()) {
+                            parent.paths.push_back(std::move(*path));
+                        }
+                    }
+
+                    if (parent.paths.empty()) {
+                        throw std::runtime_error("Bad VHD dynamic header: No parent locator.");
+                    }
+
+                    retval.m_parent = std::move(parent);
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error(std::format("Bad VHD footer: Unexpected `disk_type` {}.", std::to_underlying(retval.m_disk_type)));
+        }
+
+        retval.m_file = std::move(file);
+
+        return retval;
+    }
+}
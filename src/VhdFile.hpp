@@ -0,0 +1,143 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "VirtualDisk.hpp"
+
+namespace vmgs {
+    enum class VhdDiskType : uint32_t {
+        fixed = 2,
+        dynamic = 3,
+        differencing = 4
+    };
+
+    // A run of virtual sectors that is either stored at one contiguous range of the file or not stored at all.
+    struct VhdExtent {
+        bool present;
+        uint64_t file_offset;   // in bytes, meaningful only for present extents
+        uint64_t length;        // in bytes
+    };
+
+    // A fixed, dynamic or differencing VHD virtual disk, parsed in user space from the block device that holds the .vhd
+    // file. Sectors a differencing disk does not have read as zeros; `VirtualDiskChain` fills them from the parent.
+    //
+    // The whole BAT of a dynamic or differencing disk is kept in memory, and so are the sector bitmaps of the blocks that have been
+    // accessed, so that a read inside one data block whose sectors are all present costs a single device request.
+    // Writes to unallocated blocks allocate them in place of the footer, which is then rewritten at the new end of
+    // the file.
+    //
+    // See `Virtual Hard Disk Image Format Specification`, version 1.0.
+    class VhdFile : public IVirtualDisk {
+    public:
+        // according to `Virtual Hard Disk Format Spec_10_18_06.doc`, sector length is always 512 bytes.
+        static constexpr size_t SECTOR_SIZE = 512;
+
+        static constexpr uint32_t UNUSED_BAT_ENTRY = 0xffffffff;
+
+    private:
+        std::unique_ptr<IBlockDevice> m_file;
+        bool m_writable;
+        VhdDiskType m_disk_type;
+        uint64_t m_virtual_size;
+        uint64_t m_footer_offset;
+        std::vector<std::byte> m_footer;    // as on disk
+        std::optional<VirtualDiskParent> m_parent;
+
+        // dynamic and differencing disks only
+        uint64_t m_bat_offset;
+        uint32_t m_data_block_size;
+        std::vector<uint32_t> m_bat;        // sector offsets of data blocks
+        std::unordered_map<uint32_t, std::vector<uint8_t>> m_sector_bitmaps;
+
+        VhdFile() noexcept
+            : m_file{},
+              m_writable{},
+              m_disk_type{},
+              m_virtual_size{},
+              m_footer_offset{},
+              m_footer{},
+              m_parent{},
+              m_bat_offset{},
+              m_data_block_size{},
+              m_bat{},
+              m_sector_bitmaps{} {}
+
+        [[nodiscard]]
+        uint64_t sector_bitmap_size() const noexcept {
+            uint64_t sectors_per_block = m_data_block_size / SECTOR_SIZE;
+            return (sectors_per_block / 8 + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+        }
+
+        std::vector<uint8_t>& load_sector_bitmap(uint32_t block_index);
+
+        uint32_t allocate_data_block(uint32_t block_index);
+
+    public:
+        VhdFile(VhdFile&& other) noexcept = default;
+
+        VhdFile(const VhdFile& other) = delete;
+
+        VhdFile& operator=(VhdFile&& other) noexcept = default;
+
+        VhdFile& operator=(const VhdFile& other) = delete;
+
+        [[nodiscard]]
+        virtual size_t get_block_size() const noexcept override {
+            return SECTOR_SIZE;
+        }
+
+        [[nodiscard]]
+        virtual uint64_t get_block_count() const noexcept override {
+            return m_virtual_size / SECTOR_SIZE;
+        }
+
+        [[nodiscard]]
+        VhdDiskType get_disk_type() const noexcept {
+            return m_disk_type;
+        }
+
+        [[nodiscard]]
+        uint64_t get_virtual_size() const noexcept {
+            return m_virtual_size;
+        }
+
+        // the unique id in the footer
+        [[nodiscard]]
+        virtual std::string get_linkage_id() const override;
+
+        [[nodiscard]]
+        virtual const std::optional<VirtualDiskParent>& get_parent() const noexcept override {
+            return m_parent;
+        }
+
+        [[nodiscard]]
+        virtual std::vector<VirtualDiskRun> map_runs(uint64_t lba, uint64_t n) override;
+
+        // Splits sectors `[lba, lba + n)` into the fewest extents, merging adjacent runs of present sectors that are
+        // contiguous in the file and adjacent runs of sectors that are not present.
+        [[nodiscard]]
+        std::vector<VhdExtent> map_extents(uint64_t lba, uint64_t n);
+
+        virtual void read_blocks(uint64_t lba, uint32_t n, void* buf) override;
+
+        virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override;
+
+        virtual void flush() override {
+            m_file->flush();
+        }
+
+        // whether `file` ends with a VHD footer
+        [[nodiscard]]
+        static bool probe(IBlockDevice& file);
+
+        // `file` is the .vhd file itself, e.g. a `UnixBlockDevice` opened on it, whose block size must be 512.
+        // Differencing disks can only be opened read-only.
+        [[nodiscard]]
+        static VhdFile open(std::unique_ptr<IBlockDevice>&& file, bool writable = false);
+    };
+}
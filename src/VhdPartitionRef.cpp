@@ -1,5 +0,0 @@
-#include "VhdPartitionRef.hpp"
-
-namespace vmgs {
-
-}
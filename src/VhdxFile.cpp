@@ -0,0 +1,1278 @@
+#include "VhdxFile.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <optional>
+#include <random>
+#include <stdexcept>
+
+#include "endian_storage.hpp"
+#include "crc32.hpp"
+#include "Gpt.hpp"
+
+namespace vmgs {
+    constexpr std::array<std::byte, 8> VHDX_FILE_SIGNATURE =
+        { std::byte{'v'}, std::byte{'h'}, std::byte{'d'}, std::byte{'x'},
+          std::byte{'f'}, std::byte{'i'}, std::byte{'l'}, std::byte{'e'} };
+
+    constexpr std::array<std::byte, 4> VHDX_HEADER_SIGNATURE =
+        { std::byte{'h'}, std::byte{'e'}, std::byte{'a'}, std::byte{'d'} };
+
+    constexpr std::array<std::byte, 4> VHDX_REGION_TABLE_SIGNATURE =
+        { std::byte{'r'}, std::byte{'e'}, std::byte{'g'}, std::byte{'i'} };
+
+    constexpr std::array<std::byte, 8> VHDX_METADATA_TABLE_SIGNATURE =
+        { std::byte{'m'}, std::byte{'e'}, std::byte{'t'}, std::byte{'a'},
+          std::byte{'d'}, std::byte{'a'}, std::byte{'t'}, std::byte{'a'} };
+
+    constexpr std::array<std::byte, 4> VHDX_LOG_ENTRY_SIGNATURE =
+        { std::byte{'l'}, std::byte{'o'}, std::byte{'g'}, std::byte{'e'} };
+
+    constexpr std::array<std::byte, 4> VHDX_LOG_ZERO_DESCRIPTOR_SIGNATURE =
+        { std::byte{'z'}, std::byte{'e'}, std::byte{'r'}, std::byte{'o'} };
+
+    constexpr std::array<std::byte, 4> VHDX_LOG_DATA_DESCRIPTOR_SIGNATURE =
+        { std::byte{'d'}, std::byte{'e'}, std::byte{'s'}, std::byte{'c'} };
+
+    constexpr std::array<std::byte, 4> VHDX_LOG_DATA_SECTOR_SIGNATURE =
+        { std::byte{'d'}, std::byte{'a'}, std::byte{'t'}, std::byte{'a'} };
+
+    constexpr size_t VHDX_LOG_SECTOR_SIZE = 4096;
+
+    constexpr uint64_t VHDX_HEADER_OFFSETS[2] = { 64 * 1024, 128 * 1024 };
+    constexpr uint64_t VHDX_REGION_TABLE_OFFSETS[2] = { 192 * 1024, 256 * 1024 };
+    constexpr size_t VHDX_REGION_TABLE_SIZE = 64 * 1024;
+    constexpr size_t VHDX_METADATA_TABLE_SIZE = 64 * 1024;
+
+    constexpr uint16_t VHDX_VERSION = 1;
+    constexpr uint16_t VHDX_LOG_VERSION = 0;
+
+    constexpr GptGuid VHDX_BAT_REGION_GUID =
+        { 0x2dc27766, 0xf623, 0x4200, { 0x9d, 0x64, 0x11, 0x5e, 0x9b, 0xfd, 0x4a, 0x08 } };
+    constexpr GptGuid VHDX_METADATA_REGION_GUID =
+        { 0x8b7ca206, 0x4790, 0x4b9a, { 0xb8, 0xfe, 0x57, 0x5f, 0x05, 0x0f, 0x88, 0x6e } };
+
+    constexpr GptGuid VHDX_FILE_PARAMETERS_GUID =
+        { 0xcaa16737, 0xfa36, 0x4d43, { 0xb3, 0xb6, 0x33, 0xf0, 0xaa, 0x44, 0xe7, 0x6b } };
+    constexpr GptGuid VHDX_VIRTUAL_DISK_SIZE_GUID =
+        { 0x2fa54224, 0xcd1b, 0x4876, { 0xb2, 0x11, 0x5d, 0xbe, 0xd8, 0x3b, 0xf4, 0xb8 } };
+    constexpr GptGuid VHDX_VIRTUAL_DISK_ID_GUID =
+        { 0xbeca12ab, 0xb2e6, 0x4523, { 0x93, 0xef, 0xc3, 0x09, 0xe0, 0x00, 0xc7, 0x46 } };
+    constexpr GptGuid VHDX_LOGICAL_SECTOR_SIZE_GUID =
+        { 0x8141bf1d, 0xa96f, 0x4709, { 0xba, 0x47, 0xf2, 0x33, 0xa8, 0xfa, 0xab, 0x5f } };
+    constexpr GptGuid VHDX_PHYSICAL_SECTOR_SIZE_GUID =
+        { 0xcda348c7, 0x445d, 0x4471, { 0x9c, 0xc9, 0xe9, 0x88, 0x52, 0x51, 0xc5, 0x56 } };
+    constexpr GptGuid VHDX_PARENT_LOCATOR_GUID =
+        { 0xa8d35f2d, 0xb30b, 0x454d, { 0xab, 0xf7, 0xd3, 0xd8, 0x48, 0x34, 0xab, 0x0c } };
+
+    constexpr GptGuid VHDX_PARENT_LOCATOR_TYPE_GUID =
+        { 0xb04aefb7, 0xd19e, 0x4a81, { 0xb7, 0x89, 0x25, 0xb8, 0xe9, 0x44, 0x59, 0x13 } };
+
+    constexpr uint64_t VHDX_SB_BLOCK_PRESENT = 6;
+
+    struct VhdxGuidLayout {
+        std::array<std::byte, 4> data1;
+        std::array<std::byte, 2> data2;
+        std::array<std::byte, 2> data3;
+        std::array<std::byte, 8> data4;
+
+        [[nodiscard]]
+        GptGuid load() const noexcept {
+            GptGuid retval;
+            retval.data1 = endian_load<uint32_t, std::endian::little>(data1);
+            retval.data2 = endian_load<uint16_t, std::endian::little>(data2);
+            retval.data3 = endian_load<uint16_t, std::endian::little>(data3);
+            std::ranges::transform(data4, retval.data4.begin(), std::to_integer<uint8_t>);
+            return retval;
+        }
+    };
+
+    static_assert(sizeof(VhdxGuidLayout) == 0x10);
+    static_assert(alignof(VhdxGuidLayout) == alignof(std::byte));
+
+    struct VhdxHeader {
+        uint64_t sequence_number;
+        GptGuid log_guid;
+        uint32_t log_length;
+        uint64_t log_offset;
+    };
+
+    struct VhdxHeaderLayout {
+        std::array<std::byte, 4> signature;
+        std::array<std::byte, 4> checksum;
+        std::array<std::byte, 8> sequence_number;
+        VhdxGuidLayout file_write_guid;
+        VhdxGuidLayout data_write_guid;
+        VhdxGuidLayout log_guid;
+        std::array<std::byte, 2> log_version;
+        std::array<std::byte, 2> version;
+        std::array<std::byte, 4> log_length;
+        std::array<std::byte, 8> log_offset;
+        std::array<std::byte, 4016> reserved;
+
+        [[nodiscard]]
+        VhdxHeader load() const;
+    };
+
+    static_assert(sizeof(VhdxHeaderLayout) == 4096);
+    static_assert(alignof(VhdxHeaderLayout) == alignof(std::byte));
+
+    struct VhdxRegionTableEntryLayout {
+        VhdxGuidLayout guid;
+        std::array<std::byte, 8> file_offset;
+        std::array<std::byte, 4> length;
+        std::array<std::byte, 4> flags;
+    };
+
+    static_assert(sizeof(VhdxRegionTableEntryLayout) == 32);
+
+    struct VhdxRegionTableLayout {
+        std::array<std::byte, 4> signature;
+        std::array<std::byte, 4> checksum;
+        std::array<std::byte, 4> entry_count;
+        std::array<std::byte, 4> reserved;
+        std::array<VhdxRegionTableEntryLayout, 2047> entries;
+        std::array<std::byte, 16> reserved2;
+    };
+
+    static_assert(sizeof(VhdxRegionTableLayout) == VHDX_REGION_TABLE_SIZE);
+
+    struct VhdxMetadataTableEntryLayout {
+        VhdxGuidLayout item_id;
+        std::array<std::byte, 4> offset;
+        std::array<std::byte, 4> length;
+        std::array<std::byte, 4> flags;
+        std::array<std::byte, 4> reserved;
+    };
+
+    static_assert(sizeof(VhdxMetadataTableEntryLayout) == 32);
+
+    struct VhdxMetadataTableLayout {
+        std::array<std::byte, 8> signature;
+        std::array<std::byte, 2> reserved;
+        std::array<std::byte, 2> entry_count;
+        std::array<std::byte, 20> reserved2;
+        std::array<VhdxMetadataTableEntryLayout, (VHDX_METADATA_TABLE_SIZE - 32) / 32> entries;
+    };
+
+    static_assert(sizeof(VhdxMetadataTableLayout) == VHDX_METADATA_TABLE_SIZE);
+
+    struct VhdxParentLocatorHeaderLayout {
+        VhdxGuidLayout locator_type;
+        std::array<std::byte, 2> reserved;
+        std::array<std::byte, 2> key_value_count;
+    };
+
+    static_assert(sizeof(VhdxParentLocatorHeaderLayout) == 20);
+
+    struct VhdxParentLocatorEntryLayout {
+        std::array<std::byte, 4> key_offset;
+        std::array<std::byte, 4> value_offset;
+        std::array<std::byte, 2> key_length;
+        std::array<std::byte, 2> value_length;
+    };
+
+    static_assert(sizeof(VhdxParentLocatorEntryLayout) == 12);
+
+    struct VhdxLogEntryHeaderLayout {
+        std::array<std::byte, 4> signature;
+        std::array<std::byte, 4> checksum;
+        std::array<std::byte, 4> entry_length;
+        std::array<std::byte, 4> tail;
+        std::array<std::byte, 8> sequence_number;
+        std::array<std::byte, 4> descriptor_count;
+        std::array<std::byte, 4> reserved;
+        VhdxGuidLayout log_guid;
+        std::array<std::byte, 8> flushed_file_offset;
+        std::array<std::byte, 8> last_file_offset;
+    };
+
+    static_assert(sizeof(VhdxLogEntryHeaderLayout) == 64);
+
+    // a zero descriptor keeps `zero_length` in place of `leading_bytes` and has no `trailing_bytes`
+    struct VhdxLogDescriptorLayout {
+        std::array<std::byte, 4> signature;
+        std::array<std::byte, 4> trailing_bytes;
+        std::array<std::byte, 8> leading_bytes;
+        std::array<std::byte, 8> file_offset;
+        std::array<std::byte, 8> sequence_number;
+    };
+
+    static_assert(sizeof(VhdxLogDescriptorLayout) == 32);
+
+    struct VhdxLogDataSectorLayout {
+        std::array<std::byte, 4> signature;
+        std::array<std::byte, 4> sequence_high;
+        std::array<std::byte, 4084> data;
+        std::array<std::byte, 4> sequence_low;
+    };
+
+    static_assert(sizeof(VhdxLogDataSectorLayout) == VHDX_LOG_SECTOR_SIZE);
+
+    namespace {
+        // checksum of `size` bytes at `data`, with the 4-byte checksum field at `checksum_offset` taken as zero
+        [[nodiscard]]
+        uint32_t vhdx_checksum(const void* data, size_t size, size_t checksum_offset) noexcept {
+            auto p = reinterpret_cast<const std::byte*>(data);
+
+            uint32_t checksum = 0;
+            checksum = crc32c(checksum, p, checksum_offset);
+            checksum = crc32c(checksum, std::array<std::byte, 4>{});
+            checksum = crc32c(checksum, p + checksum_offset + 4, size - checksum_offset - 4);
+            return checksum;
+        }
+
+        // reads `size` bytes at byte `offset` of `file`, which need not be block-aligned
+        [[nodiscard]]
+        std::vector<std::byte> read_file_bytes(IBlockDevice& file, uint64_t offset, size_t size) {
+            auto block_size = file.get_block_size();
+
+            auto lba_range = lclosed_interval<uint64_t>{
+                .min = offset / block_size, .max = (offset + size + block_size - 1) / block_size
+            };
+
+            if (file.get_block_count() < lba_range.max) {
+                throw std::runtime_error(std::format("Bad VHDX: Structure at offset 0x{:x} exceeds end of file.", offset));
+            }
+
+            std::vector<std::byte> blocks(lba_range.length() * block_size);
+            file.read_blocks(lba_range, blocks.data());
+
+            auto head = static_cast<size_t>(offset % block_size);
+            if (head != 0 || blocks.size() != size) {
+                blocks.erase(blocks.begin(), blocks.begin() + head);
+                blocks.resize(size);
+            }
+
+            return blocks;
+        }
+
+        [[nodiscard]]
+        VhdxGuidLayout random_guid() {
+            std::random_device rd;
+
+            std::array<std::byte, 16> bytes;
+            for (auto& b : bytes) {
+                b = static_cast<std::byte>(rd());
+            }
+
+            bytes[7] = (bytes[7] & std::byte{ 0x0f }) | std::byte{ 0x40 };  // version 4
+            bytes[8] = (bytes[8] & std::byte{ 0x3f }) | std::byte{ 0x80 };  // variant 1
+
+            return std::bit_cast<VhdxGuidLayout>(bytes);
+        }
+
+        // number of 4 KiB sectors taken by a log entry header followed by `descriptor_count` descriptors
+        [[nodiscard]]
+        constexpr uint64_t log_descriptor_sectors(uint64_t descriptor_count) noexcept {
+            return (sizeof(VhdxLogEntryHeaderLayout) + descriptor_count * sizeof(VhdxLogDescriptorLayout) + VHDX_LOG_SECTOR_SIZE - 1) / VHDX_LOG_SECTOR_SIZE;
+        }
+
+        struct VhdxLogEntry {
+            uint64_t offset;    // in the log
+            uint64_t length;
+            uint32_t tail;
+            uint64_t sequence_number;
+            uint64_t flushed_file_offset;
+            uint64_t last_file_offset;
+            std::vector<std::pair<uint64_t, std::vector<std::byte>>> data_sectors;  // keyed by file offset
+            std::vector<std::pair<uint64_t, uint64_t>> zero_ranges;                 // file offset and length
+        };
+
+        // Parses and validates the log entry at `offset` of the circular `log`. An entry is allowed to wrap around.
+        [[nodiscard]]
+        std::optional<VhdxLogEntry> parse_log_entry(std::span<const std::byte> log, uint64_t offset, const GptGuid& log_guid) {
+            auto copy_out = [&](uint64_t off, uint64_t size) {
+                std::vector<std::byte> bytes(size);
+                for (uint64_t done = 0; done < size;) {
+                    auto pos = (off + done) % log.size();
+                    auto len = std::min<uint64_t>(size - done, log.size() - pos);
+                    memcpy(bytes.data() + done, log.data() + pos, len);
+                    done += len;
+                }
+                return bytes;
+            };
+
+            auto header_bytes = copy_out(offset, sizeof(VhdxLogEntryHeaderLayout));
+            auto header = reinterpret_cast<const VhdxLogEntryHeaderLayout*>(header_bytes.data());
+
+            if (!(header->signature == VHDX_LOG_ENTRY_SIGNATURE) || header->log_guid.load() != log_guid) {
+                return std::nullopt;
+            }
+
+            VhdxLogEntry retval;
+            retval.offset = offset;
+            retval.length = endian_load<uint32_t, std::endian::little>(header->entry_length);
+            retval.tail = endian_load<uint32_t, std::endian::little>(header->tail);
+            retval.sequence_number = endian_load<uint64_t, std::endian::little>(header->sequence_number);
+            retval.flushed_file_offset = endian_load<uint64_t, std::endian::little>(header->flushed_file_offset);
+            retval.last_file_offset = endian_load<uint64_t, std::endian::little>(header->last_file_offset);
+
+            uint32_t descriptor_count = endian_load<uint32_t, std::endian::little>(header->descriptor_count);
+
+            if (retval.length == 0 || retval.length % VHDX_LOG_SECTOR_SIZE != 0 || log.size() < retval.length ||
+                retval.tail % VHDX_LOG_SECTOR_SIZE != 0 || log.size() <= retval.tail || retval.sequence_number == 0 ||
+                retval.length / VHDX_LOG_SECTOR_SIZE < log_descriptor_sectors(descriptor_count))
+            {
+                return std::nullopt;
+            }
+
+            auto entry_bytes = copy_out(offset, retval.length);
+            if (endian_load<uint32_t, std::endian::little>(header->checksum) != vhdx_checksum(entry_bytes.data(), entry_bytes.size(), offsetof(VhdxLogEntryHeaderLayout, checksum))) {
+                return std::nullopt;
+            }
+
+            uint64_t data_sector_index = log_descriptor_sectors(descriptor_count);
+            for (uint32_t i = 0; i < descriptor_count; ++i) {
+                auto descriptor = reinterpret_cast<const VhdxLogDescriptorLayout*>(entry_bytes.data() + sizeof(VhdxLogEntryHeaderLayout) + i * sizeof(VhdxLogDescriptorLayout));
+
+                uint64_t file_offset = endian_load<uint64_t, std::endian::little>(descriptor->file_offset);
+                if (file_offset % VHDX_LOG_SECTOR_SIZE != 0 || endian_load<uint64_t, std::endian::little>(descriptor->sequence_number) != retval.sequence_number) {
+                    return std::nullopt;
+                }
+
+                if (descriptor->signature == VHDX_LOG_ZERO_DESCRIPTOR_SIGNATURE) {
+                    uint64_t zero_length = endian_load<uint64_t, std::endian::little>(descriptor->leading_bytes);
+                    if (zero_length % VHDX_LOG_SECTOR_SIZE != 0) {
+                        return std::nullopt;
+                    }
+                    retval.zero_ranges.emplace_back(file_offset, zero_length);
+                } else if (descriptor->signature == VHDX_LOG_DATA_DESCRIPTOR_SIGNATURE) {
+                    if (retval.length / VHDX_LOG_SECTOR_SIZE <= data_sector_index) {
+                        return std::nullopt;
+                    }
+
+                    auto data_sector = reinterpret_cast<const VhdxLogDataSectorLayout*>(entry_bytes.data() + data_sector_index * VHDX_LOG_SECTOR_SIZE);
+                    if (!(data_sector->signature == VHDX_LOG_DATA_SECTOR_SIGNATURE) ||
+                        endian_load<uint32_t, std::endian::little>(data_sector->sequence_high) != static_cast<uint32_t>(retval.sequence_number >> 32) ||
+                        endian_load<uint32_t, std::endian::little>(data_sector->sequence_low) != static_cast<uint32_t>(retval.sequence_number))
+                    {
+                        return std::nullopt;
+                    }
+
+                    // the first 8 and the last 4 bytes of the sector live in the descriptor
+                    std::vector<std::byte> sector(VHDX_LOG_SECTOR_SIZE);
+                    std::ranges::copy(descriptor->leading_bytes, sector.begin());
+                    std::ranges::copy(data_sector->data, sector.begin() + 8);
+                    std::ranges::copy(descriptor->trailing_bytes, sector.end() - 4);
+
+                    retval.data_sectors.emplace_back(file_offset, std::move(sector));
+                    ++data_sector_index;
+                } else {
+                    return std::nullopt;
+                }
+            }
+
+            if (data_sector_index != retval.length / VHDX_LOG_SECTOR_SIZE) {
+                return std::nullopt;
+            }
+
+            return retval;
+        }
+
+        // Finds the active sequence of the log: the valid sequence ending with the entry of the greatest sequence
+        // number, which goes back, entry by entry, to the tail that entry names.
+        [[nodiscard]]
+        std::vector<VhdxLogEntry> find_log_sequence(std::span<const std::byte> log, const GptGuid& log_guid) {
+            std::map<uint64_t, VhdxLogEntry> entries;
+            for (uint64_t offset = 0; offset < log.size(); offset += VHDX_LOG_SECTOR_SIZE) {
+                if (auto entry = parse_log_entry(log, offset, log_guid)) {
+                    entries.emplace(offset, std::move(entry.value()));
+                }
+            }
+
+            std::vector<const VhdxLogEntry*> candidates;
+            for (const auto& [_, entry] : entries) {
+                candidates.push_back(&entry);
+            }
+
+            std::ranges::sort(candidates, std::ranges::greater{}, &VhdxLogEntry::sequence_number);
+
+            for (auto candidate : candidates) {
+                std::vector<VhdxLogEntry> sequence;
+
+                uint64_t offset = candidate->tail;
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    auto iter = entries.find(offset);
+                    if (iter == entries.end() || (!sequence.empty() && iter->second.sequence_number != sequence.back().sequence_number + 1)) {
+                        break;
+                    }
+
+                    sequence.push_back(iter->second);
+
+                    if (iter->second.offset == candidate->offset) {
+                        return sequence;
+                    }
+
+                    offset = (offset + iter->second.length) % log.size();
+                }
+            }
+
+            return {};
+        }
+
+        // Serves reads of a read-only file with the 4 KiB sectors replayed from its log applied on top.
+        class VhdxLogOverlay : public IBlockDevice {
+        private:
+            std::unique_ptr<IBlockDevice> m_file;
+            uint64_t m_block_count;     // the log may extend the file
+            std::map<uint64_t, std::vector<std::byte>> m_sectors;   // keyed by file offset
+
+        public:
+            VhdxLogOverlay(std::unique_ptr<IBlockDevice>&& file, uint64_t block_count, std::map<uint64_t, std::vector<std::byte>>&& sectors) noexcept
+                : m_file{ std::move(file) }, m_block_count{ block_count }, m_sectors{ std::move(sectors) } {}
+
+            [[nodiscard]]
+            virtual size_t get_block_size() const override {
+                return m_file->get_block_size();
+            }
+
+            [[nodiscard]]
+            virtual uint64_t get_block_count() const override {
+                return m_block_count;
+            }
+
+            virtual void read_blocks(uint64_t lba, uint32_t n, void* buf) override {
+                auto block_size = m_file->get_block_size();
+                auto file_block_count = m_file->get_block_count();
+                auto p = static_cast<std::byte*>(buf);
+
+                auto n_in_file = static_cast<uint32_t>(lba < file_block_count ? std::min<uint64_t>(n, file_block_count - lba) : 0);
+                m_file->read_blocks(lba, n_in_file, p);
+                memset(p + static_cast<size_t>(n_in_file) * block_size, 0, static_cast<size_t>(n - n_in_file) * block_size);
+
+                uint64_t begin = lba * block_size;
+                uint64_t end = begin + static_cast<uint64_t>(n) * block_size;
+                for (auto iter = m_sectors.lower_bound(begin - begin % VHDX_LOG_SECTOR_SIZE); iter != m_sectors.end() && iter->first < end; ++iter) {
+                    auto overlap_min = std::max(begin, iter->first);
+                    auto overlap_max = std::min(end, iter->first + VHDX_LOG_SECTOR_SIZE);
+                    memcpy(p + (overlap_min - begin), iter->second.data() + (overlap_min - iter->first), overlap_max - overlap_min);
+                }
+            }
+
+            virtual void write_blocks(uint64_t, uint32_t, const void*) override {
+                throw std::runtime_error("VHDX is opened read-only.");
+            }
+        };
+
+        [[nodiscard]]
+        VirtualDiskParent parse_parent_locator(std::span<const std::byte> item) {
+            if (item.size() < sizeof(VhdxParentLocatorHeaderLayout)) {
+                throw std::runtime_error("Bad VHDX parent locator: Insufficient data.");
+            }
+
+            auto header = reinterpret_cast<const VhdxParentLocatorHeaderLayout*>(item.data());
+            if (header->locator_type.load() != VHDX_PARENT_LOCATOR_TYPE_GUID) {
+                throw std::runtime_error(std::format("Bad VHDX parent locator: Unknown locator type {}.", header->locator_type.load()));
+            }
+
+            uint16_t key_value_count = endian_load<uint16_t, std::endian::little>(header->key_value_count);
+            if ((item.size() - sizeof(VhdxParentLocatorHeaderLayout)) / sizeof(VhdxParentLocatorEntryLayout) < key_value_count) {
+                throw std::runtime_error("Bad VHDX parent locator: `key_value_count` exceeded.");
+            }
+
+            auto load_string = [item](const std::array<std::byte, 4>& offset_field, const std::array<std::byte, 2>& length_field) {
+                uint32_t offset = endian_load<uint32_t, std::endian::little>(offset_field);
+                uint16_t length = endian_load<uint16_t, std::endian::little>(length_field);
+                if (item.size() < static_cast<uint64_t>(offset) + length || length % 2 != 0) {
+                    throw std::runtime_error("Bad VHDX parent locator: Entry exceeds the item.");
+                }
+
+                std::u16string retval(length / 2, u'\0');
+                for (size_t i = 0; i < retval.size(); ++i) {
+                    retval[i] = endian_load<char16_t, std::endian::little>(std::span<const std::byte, 2>{ item.data() + offset + i * 2, 2 });
+                }
+                return retval;
+            };
+
+            std::optional<std::u16string> linkage;
+            std::u16string relative_path;
+            std::u16string volume_path;
+            std::u16string absolute_path;
+
+            auto entries = reinterpret_cast<const VhdxParentLocatorEntryLayout*>(item.data() + sizeof(VhdxParentLocatorHeaderLayout));
+            for (const auto& entry : std::span{ entries, key_value_count }) {
+                auto key = load_string(entry.key_offset, entry.key_length);
+                auto value = load_string(entry.value_offset, entry.value_length);
+
+                if (key == u"parent_linkage") {
+                    linkage = std::move(value);
+                } else if (key == u"relative_path") {
+                    relative_path = std::move(value);
+                } else if (key == u"volume_path") {
+                    volume_path = std::move(value);
+                } else if (key == u"absolute_win32_path") {
+                    absolute_path = std::move(value);
+                }
+            }
+
+            if (!linkage.has_value()) {
+                throw std::runtime_error("Bad VHDX parent locator: `parent_linkage` is missing.");
+            }
+
+            // the linkage is a GUID in braces
+            VirtualDiskParent retval;
+            for (auto c : linkage.value()) {
+                if (c == u'{' || c == u'}') {
+                    continue;
+                }
+
+                if (0x80 <= c) {
+                    throw std::runtime_error("Bad VHDX parent locator: Invalid `parent_linkage`.");
+                }
+
+                retval.linkage_id.push_back(static_cast<char>(u'A' <= c && c <= u'Z' ? c - u'A' + u'a' : c));
+            }
+
+            for (auto* path : { &relative_path, &volume_path, &absolute_path }) {
+                if (!path->empty()) {
+                    retval.paths.push_back(std::move(*path));
+                }
+            }
+
+            if (retval.paths.empty()) {
+                throw std::runtime_error("Bad VHDX parent locator: No parent path.");
+            }
+
+            return retval;
+        }
+    }
+
+    VhdxHeader VhdxHeaderLayout::load() const {
+        VhdxHeader retval;
+
+        if (!(signature == VHDX_HEADER_SIGNATURE)) {
+            throw std::runtime_error("Bad VHDX header: Invalid signature.");
+        }
+
+        {
+            uint32_t checksum_ = endian_load<uint32_t, std::endian::little>(checksum);
+            uint32_t expected = vhdx_checksum(this, sizeof(VhdxHeaderLayout), offsetof(VhdxHeaderLayout, checksum));
+            if (checksum_ != expected) {
+                throw std::runtime_error(std::format("Bad VHDX header: Invalid checksum, expect 0x{:08x}, but got 0x{:08x}.", expected, checksum_));
+            }
+        }
+
+        {
+            uint16_t version_ = endian_load<uint16_t, std::endian::little>(version);
+            if (version_ != VHDX_VERSION) {
+                throw std::runtime_error(std::format("Bad VHDX header: Unexpected `version`, expect {}, but got {}.", VHDX_VERSION, version_));
+            }
+        }
+
+        {
+            uint16_t log_version_ = endian_load<uint16_t, std::endian::little>(log_version);
+            if (log_version_ != VHDX_LOG_VERSION) {
+                throw std::runtime_error(std::format("Bad VHDX header: Unexpected `log_version`, expect {}, but got {}.", VHDX_LOG_VERSION, log_version_));
+            }
+        }
+
+        retval.sequence_number = endian_load<uint64_t, std::endian::little>(sequence_number);
+        retval.log_guid = log_guid.load();
+        retval.log_length = endian_load<uint32_t, std::endian::little>(log_length);
+        retval.log_offset = endian_load<uint64_t, std::endian::little>(log_offset);
+
+        return retval;
+    }
+
+    uint32_t* VhdxBat::load_page(IBlockDevice& file, uint64_t page_index) {
+        uint64_t first = page_index * PAGE_ENTRIES;
+        uint64_t last = std::min(first + PAGE_ENTRIES, m_entry_count);
+
+        // on-disk entries covering payload entries [first, last), with sector bitmap entries interleaved
+        uint64_t raw_first = first + first / m_chunk_ratio;
+        uint64_t raw_last = (last - 1) + (last - 1) / m_chunk_ratio + 1;
+
+        auto raw_bytes = read_file_bytes(file, m_file_offset + raw_first * 8, (raw_last - raw_first) * 8);
+
+        auto page = std::make_unique<uint32_t[]>(PAGE_ENTRIES);
+        for (uint64_t i = first; i < last; ++i) {
+            uint64_t raw_index = i + i / m_chunk_ratio;
+            uint64_t raw = endian_load<uint64_t, std::endian::little>(std::span<const std::byte, 8>{ raw_bytes.data() + (raw_index - raw_first) * 8, 8 });
+
+            uint64_t state = raw & 0x7;
+            uint64_t file_offset_mb = raw >> 20;
+
+            switch (static_cast<VhdxPayloadBlockState>(state)) {
+                case VhdxPayloadBlockState::not_present:
+                case VhdxPayloadBlockState::undefined:
+                case VhdxPayloadBlockState::zero:
+                case VhdxPayloadBlockState::unmapped:
+                    file_offset_mb = 0;
+                    break;
+                case VhdxPayloadBlockState::fully_present:
+                case VhdxPayloadBlockState::partially_present:
+                    if (file_offset_mb == 0 || (uint64_t{ 1 } << 29) <= file_offset_mb) {
+                        throw std::runtime_error(std::format("Bad VHDX BAT: Invalid file offset of payload block {}.", i));
+                    }
+                    break;
+                default:
+                    throw std::runtime_error(std::format("Bad VHDX BAT: Unexpected state {} of payload block {}.", state, i));
+            }
+
+            page[i - first] = static_cast<uint32_t>(file_offset_mb << 3 | state);
+        }
+
+        m_pages[page_index] = std::move(page);
+        return m_pages[page_index].get();
+    }
+
+    VhdxBatEntry VhdxBat::lookup(IBlockDevice& file, uint64_t block_index) {
+        if (m_entry_count <= block_index) {
+            throw std::out_of_range(std::format("VHDX payload block {} is out of range.", block_index));
+        }
+
+        auto page = m_pages[block_index / PAGE_ENTRIES].get();
+        if (page == nullptr) {
+            page = load_page(file, block_index / PAGE_ENTRIES);
+        }
+
+        uint32_t v = page[block_index % PAGE_ENTRIES];
+        return VhdxBatEntry{ .state = static_cast<VhdxPayloadBlockState>(v & 0x7), .file_offset = uint64_t{ v >> 3 } * VhdxFile::FILE_OFFSET_UNIT };
+    }
+
+    std::optional<uint64_t> VhdxBat::lookup_sector_bitmap(IBlockDevice& file, uint64_t chunk_index) {
+        if ((m_entry_count + m_chunk_ratio - 1) / m_chunk_ratio <= chunk_index) {
+            throw std::out_of_range(std::format("VHDX sector bitmap block {} is out of range.", chunk_index));
+        }
+
+        // every chunk of payload entries is followed by the entry of its sector bitmap block
+        uint64_t raw_index = chunk_index * (m_chunk_ratio + 1) + m_chunk_ratio;
+        auto raw_bytes = read_file_bytes(file, m_file_offset + raw_index * 8, 8);
+        uint64_t raw = endian_load<uint64_t, std::endian::little>(std::span<const std::byte, 8>{ raw_bytes.data(), 8 });
+
+        uint64_t state = raw & 0x7;
+        uint64_t file_offset_mb = raw >> 20;
+
+        if (state != VHDX_SB_BLOCK_PRESENT) {
+            return std::nullopt;
+        }
+
+        if (file_offset_mb == 0) {
+            throw std::runtime_error(std::format("Bad VHDX BAT: Invalid file offset of sector bitmap block {}.", chunk_index));
+        }
+
+        return file_offset_mb * VhdxFile::FILE_OFFSET_UNIT;
+    }
+
+    void VhdxBat::update(IBlockDevice& file, uint64_t block_index, const VhdxBatEntry& entry) {
+        static_cast<void>(lookup(file, block_index));   // brings the page in
+
+        uint64_t file_offset_mb = entry.file_offset / VhdxFile::FILE_OFFSET_UNIT;
+        if ((uint64_t{ 1 } << 29) <= file_offset_mb) {
+            throw std::runtime_error("VHDX file is too large.");
+        }
+
+        m_pages[block_index / PAGE_ENTRIES][block_index % PAGE_ENTRIES] = static_cast<uint32_t>(file_offset_mb << 3 | std::to_underlying(entry.state));
+
+        uint64_t raw_offset = m_file_offset + (block_index + block_index / m_chunk_ratio) * 8;
+        uint64_t sector_offset = raw_offset - raw_offset % SECTOR_SIZE;
+
+        auto iter = m_dirty_sectors.find(sector_offset);
+        if (iter == m_dirty_sectors.end()) {
+            iter = m_dirty_sectors.emplace(sector_offset, read_file_bytes(file, sector_offset, SECTOR_SIZE)).first;
+        }
+
+        endian_store<uint64_t, std::endian::little>(
+            std::span<std::byte, 8>{ iter->second.data() + (raw_offset - sector_offset), 8 }, file_offset_mb << 20 | std::to_underlying(entry.state)
+        );
+    }
+
+    const std::vector<std::byte>& VhdxFile::load_sector_bitmap(uint64_t block_index) {
+        auto iter = m_sector_bitmaps.find(block_index);
+        if (iter == m_sector_bitmaps.end()) {
+            auto bitmap_offset = m_bat.lookup_sector_bitmap(*m_file, block_index / m_bat.chunk_ratio());
+            if (!bitmap_offset.has_value()) {
+                throw std::runtime_error(std::format("Bad VHDX BAT: Sector bitmap of partially present block {} is not present.", block_index));
+            }
+
+            // a sector bitmap block holds the bits of `chunk_ratio` payload blocks in order
+            uint64_t bitmap_size = m_payload_block_size / m_logical_sector_size / 8;
+            uint64_t offset = bitmap_offset.value() + block_index % m_bat.chunk_ratio() * bitmap_size;
+
+            iter = m_sector_bitmaps.emplace(block_index, read_file_bytes(*m_file, offset, bitmap_size)).first;
+        }
+        return iter->second;
+    }
+
+    std::vector<VhdxExtent> VhdxFile::map_extents(uint64_t lba, uint64_t n) {
+        if (get_block_count() < lba || get_block_count() - lba < n) {
+            throw std::out_of_range(std::format("VHDX access out of range: [0x{:x}, 0x{:x}).", lba, lba + n));
+        }
+
+        uint64_t sectors_per_block = m_payload_block_size / m_logical_sector_size;
+
+        std::vector<VhdxExtent> extents;
+
+        auto append = [&extents](const VhdxExtent& extent) {
+            if (!extents.empty() && extents.back().state == extent.state &&
+                (extent.state != VhdxPayloadBlockState::fully_present || extents.back().file_offset + extents.back().length == extent.file_offset))
+            {
+                extents.back().length += extent.length;
+            } else {
+                extents.push_back(extent);
+            }
+        };
+
+        while (0 < n) {
+            uint64_t block_index = lba / sectors_per_block;
+            uint64_t sector_index = lba % sectors_per_block;
+            uint64_t count = std::min<uint64_t>(n, sectors_per_block - sector_index);
+
+            auto entry = m_bat.lookup(*m_file, block_index);
+
+            switch (entry.state) {
+                case VhdxPayloadBlockState::fully_present:
+                    append(
+                        VhdxExtent{
+                            .state = VhdxPayloadBlockState::fully_present,
+                            .file_offset = entry.file_offset + sector_index * m_logical_sector_size,
+                            .length = count * m_logical_sector_size
+                        }
+                    );
+                    break;
+                case VhdxPayloadBlockState::partially_present: {
+                    // bit `i % 8` of byte `i / 8` is sector `i`
+                    const auto& bitmap = load_sector_bitmap(block_index);
+                    for (uint64_t i = sector_index; i < sector_index + count; ++i) {
+                        bool present = (std::to_integer<uint8_t>(bitmap[i / 8]) >> (i % 8)) & 1;
+                        append(
+                            VhdxExtent{
+                                .state = present ? VhdxPayloadBlockState::fully_present : VhdxPayloadBlockState::not_present,
+                                .file_offset = present ? entry.file_offset + i * m_logical_sector_size : 0,
+                                .length = m_logical_sector_size
+                            }
+                        );
+                    }
+                    break;
+                }
+                case VhdxPayloadBlockState::not_present:
+                    // only a differencing disk has a parent to take the block from
+                    if (m_parent.has_value()) {
+                        append(VhdxExtent{ .state = VhdxPayloadBlockState::not_present, .file_offset = 0, .length = count * m_logical_sector_size });
+                        break;
+                    }
+                    [[fallthrough]];
+                default:
+                    // states that read as zeros are interchangeable
+                    append(VhdxExtent{ .state = VhdxPayloadBlockState::zero, .file_offset = 0, .length = count * m_logical_sector_size });
+                    break;
+            }
+
+            lba += count;
+            n -= count;
+        }
+
+        return extents;
+    }
+
+    std::vector<VirtualDiskRun> VhdxFile::map_runs(uint64_t lba, uint64_t n) {
+        std::vector<VirtualDiskRun> runs;
+        for (const auto& extent : map_extents(lba, n)) {
+            bool inherited = extent.state == VhdxPayloadBlockState::not_present;
+            if (!runs.empty() && runs.back().inherited == inherited) {
+                runs.back().n += extent.length / m_logical_sector_size;
+            } else {
+                runs.push_back(VirtualDiskRun{ .n = extent.length / m_logical_sector_size, .inherited = inherited });
+            }
+        }
+        return runs;
+    }
+
+    std::string VhdxFile::get_linkage_id() const {
+        return std::format("{:x}", reinterpret_cast<const VhdxHeaderLayout*>(m_header.data())->data_write_guid.load());
+    }
+
+    void VhdxFile::read_blocks(uint64_t lba, uint32_t n, void* buf) {
+        auto file_block_size = m_file->get_block_size();
+
+        std::vector<BlockRequest> requests;
+
+        auto p = static_cast<std::byte*>(buf);
+        for (const auto& extent : map_extents(lba, n)) {
+            switch (extent.state) {
+                case VhdxPayloadBlockState::zero:
+                case VhdxPayloadBlockState::not_present:
+                    memset(p, 0, extent.length);
+                    break;
+                case VhdxPayloadBlockState::fully_present:
+                    // `n` sectors may be more than `UINT32_MAX` blocks of the file
+                    for (uint64_t offset = 0; offset < extent.length;) {
+                        auto chunk = std::min<uint64_t>(extent.length - offset, std::numeric_limits<uint32_t>::max() / file_block_size * file_block_size);
+                        requests.push_back(
+                            BlockRequest{
+                                .lba = (extent.file_offset + offset) / file_block_size,
+                                .n = static_cast<uint32_t>(chunk / file_block_size),
+                                .buf = p + offset
+                            }
+                        );
+                        offset += chunk;
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            p += extent.length;
+        }
+
+        m_file->read_blocks(requests);
+    }
+
+    void VhdxFile::write_blocks(uint64_t lba, uint32_t n, const void* buf) {
+        auto extents = map_extents(lba, n);
+
+        begin_write();
+
+        auto file_block_size = m_file->get_block_size();
+        uint64_t sectors_per_block = m_payload_block_size / m_logical_sector_size;
+
+        auto p = static_cast<const std::byte*>(buf);
+        for (const auto& extent : extents) {
+            switch (extent.state) {
+                case VhdxPayloadBlockState::fully_present:
+                    m_file->write_blocks(
+                        lclosed_interval<uint64_t>{ .min = extent.file_offset / file_block_size, .max = (extent.file_offset + extent.length) / file_block_size }, p
+                    );
+                    break;
+                case VhdxPayloadBlockState::zero:
+                    // every block of the extent gets allocated at the end of the file
+                    for (uint64_t done = 0; done < extent.length;) {
+                        uint64_t block_index = lba / sectors_per_block;
+                        uint64_t sector_index = lba % sectors_per_block;
+                        uint64_t count = std::min<uint64_t>((extent.length - done) / m_logical_sector_size, sectors_per_block - sector_index);
+
+                        uint64_t block_offset = (m_file_size + FILE_OFFSET_UNIT - 1) / FILE_OFFSET_UNIT * FILE_OFFSET_UNIT;
+                        uint64_t data_offset = block_offset + sector_index * m_logical_sector_size;
+                        uint64_t data_end = data_offset + count * m_logical_sector_size;
+                        uint64_t block_end = block_offset + m_payload_block_size;
+
+                        // sectors before and after the written ones are past the end of the file, and so read as zeros,
+                        // as long as the file is extended to the end of the block
+                        m_file->write_blocks(lclosed_interval<uint64_t>{ .min = data_offset / file_block_size, .max = data_end / file_block_size }, p + done);
+                        if (data_end < block_end) {
+                            std::vector<std::byte> zero_block(file_block_size);
+                            m_file->write_blocks(block_end / file_block_size - 1, 1, zero_block.data());
+                        }
+
+                        m_file_size = block_end;
+                        m_bat.update(*m_file, block_index, VhdxBatEntry{ .state = VhdxPayloadBlockState::fully_present, .file_offset = block_offset });
+
+                        lba += count;
+                        done += count * m_logical_sector_size;
+                    }
+                    p += extent.length;
+                    continue;
+                default:
+                    throw std::runtime_error("Differencing VHDX is opened read-only.");
+            }
+
+            lba += extent.length / m_logical_sector_size;
+            p += extent.length;
+        }
+    }
+
+    void VhdxFile::update_header(bool open_log) {
+        auto header = m_header;
+        auto layout = reinterpret_cast<VhdxHeaderLayout*>(header.data());
+
+        endian_store<uint64_t, std::endian::little>(layout->sequence_number, endian_load<uint64_t, std::endian::little>(layout->sequence_number) + 1);
+
+        if (open_log) {
+            layout->file_write_guid = random_guid();
+            layout->data_write_guid = random_guid();
+            layout->log_guid = random_guid();
+        } else {
+            layout->log_guid = VhdxGuidLayout{};
+        }
+
+        endian_store<uint32_t, std::endian::little>(layout->checksum, vhdx_checksum(layout, sizeof(VhdxHeaderLayout), offsetof(VhdxHeaderLayout, checksum)));
+
+        auto file_block_size = m_file->get_block_size();
+        auto offset = VHDX_HEADER_OFFSETS[1 - m_header_index];
+        m_file->write_blocks(lclosed_interval<uint64_t>{ .min = offset / file_block_size, .max = (offset + header.size()) / file_block_size }, header.data());
+        m_file->flush();
+
+        m_header_index = 1 - m_header_index;
+        m_header = std::move(header);
+    }
+
+    void VhdxFile::begin_write() {
+        if (!m_writable) {
+            throw std::runtime_error("VHDX is opened read-only.");
+        }
+
+        // the spec asks for new `file_write_guid` and `data_write_guid` before the first write after open
+        if (!m_log_open) {
+            update_header(true);
+            m_log_open = true;
+            m_log_head = 0;
+            m_log_sequence_number = 1;
+        }
+    }
+
+    void VhdxFile::commit_bat() {
+        auto sectors = m_bat.take_dirty_sectors();
+        auto log_guid = reinterpret_cast<const VhdxHeaderLayout*>(m_header.data())->log_guid;
+        auto file_block_size = m_file->get_block_size();
+
+        for (auto iter = sectors.begin(); iter != sectors.end();) {
+            // New payload blocks must be durable before the BAT refers to them, and so must the BAT sectors applied
+            // after the previous entry, which lets every entry be the tail of its own sequence.
+            m_file->flush();
+
+            uint64_t count = 0;
+            for (auto it = iter; it != sectors.end() && (log_descriptor_sectors(count + 1) + count + 1) * VHDX_LOG_SECTOR_SIZE <= m_log_length; ++it) {
+                ++count;
+            }
+
+            if (count == 0) {
+                throw std::runtime_error("Bad VHDX: The log is too small.");
+            }
+
+            uint64_t descriptor_sectors = log_descriptor_sectors(count);
+            uint64_t entry_length = (descriptor_sectors + count) * VHDX_LOG_SECTOR_SIZE;
+            uint64_t sequence_number = m_log_sequence_number++;
+
+            if (m_log_length < m_log_head + entry_length) {
+                m_log_head = 0;
+            }
+
+            std::vector<std::byte> entry(entry_length);
+
+            auto header = reinterpret_cast<VhdxLogEntryHeaderLayout*>(entry.data());
+            header->signature = VHDX_LOG_ENTRY_SIGNATURE;
+            endian_store<uint32_t, std::endian::little>(header->entry_length, static_cast<uint32_t>(entry_length));
+            endian_store<uint32_t, std::endian::little>(header->tail, static_cast<uint32_t>(m_log_head));
+            endian_store<uint64_t, std::endian::little>(header->sequence_number, sequence_number);
+            endian_store<uint32_t, std::endian::little>(header->descriptor_count, static_cast<uint32_t>(count));
+            header->log_guid = log_guid;
+            endian_store<uint64_t, std::endian::little>(header->flushed_file_offset, m_file_size);
+            endian_store<uint64_t, std::endian::little>(header->last_file_offset, m_file_size);
+
+            auto first = iter;
+            for (uint64_t i = 0; i < count; ++i, ++iter) {
+                const auto& [file_offset, sector] = *iter;
+
+                auto descriptor = reinterpret_cast<VhdxLogDescriptorLayout*>(entry.data() + sizeof(VhdxLogEntryHeaderLayout) + i * sizeof(VhdxLogDescriptorLayout));
+                descriptor->signature = VHDX_LOG_DATA_DESCRIPTOR_SIGNATURE;
+                std::ranges::copy(std::span{ sector }.last(4), descriptor->trailing_bytes.begin());
+                std::ranges::copy(std::span{ sector }.first(8), descriptor->leading_bytes.begin());
+                endian_store<uint64_t, std::endian::little>(descriptor->file_offset, file_offset);
+                endian_store<uint64_t, std::endian::little>(descriptor->sequence_number, sequence_number);
+
+                auto data_sector = reinterpret_cast<VhdxLogDataSectorLayout*>(entry.data() + (descriptor_sectors + i) * VHDX_LOG_SECTOR_SIZE);
+                data_sector->signature = VHDX_LOG_DATA_SECTOR_SIGNATURE;
+                endian_store<uint32_t, std::endian::little>(data_sector->sequence_high, static_cast<uint32_t>(sequence_number >> 32));
+                std::ranges::copy(std::span{ sector }.subspan(8, data_sector->data.size()), data_sector->data.begin());
+                endian_store<uint32_t, std::endian::little>(data_sector->sequence_low, static_cast<uint32_t>(sequence_number));
+            }
+
+            endian_store<uint32_t, std::endian::little>(header->checksum, vhdx_checksum(entry.data(), entry.size(), offsetof(VhdxLogEntryHeaderLayout, checksum)));
+
+            uint64_t entry_offset = m_log_offset + m_log_head;
+            m_file->write_blocks(lclosed_interval<uint64_t>{ .min = entry_offset / file_block_size, .max = (entry_offset + entry_length) / file_block_size }, entry.data());
+            m_file->flush();
+
+            m_log_head += entry_length;
+
+            // once the entry is durable, the BAT sectors can go to their final place without a flush of their own
+            for (auto it = first; it != iter; ++it) {
+                m_file->write_blocks(lclosed_interval<uint64_t>{ .min = it->first / file_block_size, .max = (it->first + VhdxBat::SECTOR_SIZE) / file_block_size }, it->second.data());
+            }
+        }
+    }
+
+    void VhdxFile::flush() {
+        commit_bat();
+        m_file->flush();
+    }
+
+    void VhdxFile::close() {
+        if (m_file && m_log_open) {
+            flush();
+            update_header(false);
+            m_log_open = false;
+        }
+    }
+
+    VhdxFile::~VhdxFile() noexcept {
+        // an error here leaves the log GUID set, which only costs a replay of the last entry on next open
+        try {
+            close();
+        } catch (...) {
+        }
+    }
+
+    bool VhdxFile::probe(IBlockDevice& file) {
+        if (VHDX_LOG_SECTOR_SIZE % file.get_block_size() != 0 || file.get_block_count() * file.get_block_size() < VHDX_FILE_SIGNATURE.size()) {
+            return false;
+        }
+
+        return std::ranges::equal(read_file_bytes(file, 0, VHDX_FILE_SIGNATURE.size()), VHDX_FILE_SIGNATURE);
+    }
+
+    VhdxFile VhdxFile::open(std::unique_ptr<IBlockDevice>&& file, bool writable) {
+        VhdxFile retval;
+
+        if (VHDX_LOG_SECTOR_SIZE % file->get_block_size() != 0) {
+            throw std::runtime_error("Bad VHDX: Block size of the file does not divide 4 KiB.");
+        }
+
+        {
+            auto identifier = read_file_bytes(*file, 0, VHDX_FILE_SIGNATURE.size());
+            if (!std::ranges::equal(identifier, VHDX_FILE_SIGNATURE)) {
+                throw std::runtime_error("Bad VHDX: Invalid file identifier.");
+            }
+        }
+
+        // the current header is the valid one with the greater sequence number
+        std::optional<VhdxHeader> header;
+        for (size_t i = 0; i < std::size(VHDX_HEADER_OFFSETS); ++i) {
+            auto header_bytes = read_file_bytes(*file, VHDX_HEADER_OFFSETS[i], sizeof(VhdxHeaderLayout));
+            try {
+                auto h = reinterpret_cast<const VhdxHeaderLayout*>(header_bytes.data())->load();
+                if (!header.has_value() || header->sequence_number < h.sequence_number) {
+                    header = h;
+                    retval.m_header_index = i;
+                    retval.m_header = std::move(header_bytes);
+                }
+            } catch (std::runtime_error&) {
+                // the other header may still be valid
+            }
+        }
+
+        if (!header.has_value()) {
+            throw std::runtime_error("Bad VHDX: No valid header.");
+        }
+
+        if (header->log_offset % FILE_OFFSET_UNIT != 0 || header->log_length % FILE_OFFSET_UNIT != 0 || header->log_length == 0) {
+            throw std::runtime_error("Bad VHDX header: Log is not aligned to 1 MiB.");
+        }
+
+        retval.m_writable = writable;
+        retval.m_file_size = file->get_block_count() * file->get_block_size();
+        retval.m_log_offset = header->log_offset;
+        retval.m_log_length = header->log_length;
+
+        if (header->log_guid != GptGuid{}) {
+            auto log = read_file_bytes(*file, header->log_offset, header->log_length);
+            auto sequence = find_log_sequence(log, header->log_guid);
+
+            if (!sequence.empty()) {
+                if (retval.m_file_size < sequence.back().flushed_file_offset) {
+                    throw std::runtime_error("Bad VHDX: File is smaller than the log claims it was flushed.");
+                }
+
+                std::map<uint64_t, std::vector<std::byte>> sectors;
+                for (auto& entry : sequence) {
+                    for (auto [file_offset, length] : entry.zero_ranges) {
+                        for (uint64_t offset = 0; offset < length; offset += VHDX_LOG_SECTOR_SIZE) {
+                            sectors.insert_or_assign(file_offset + offset, std::vector<std::byte>(VHDX_LOG_SECTOR_SIZE));
+                        }
+                    }
+
+                    for (auto& [file_offset, sector] : entry.data_sectors) {
+                        sectors.insert_or_assign(file_offset, std::move(sector));
+                    }
+                }
+
+                auto file_block_size = file->get_block_size();
+                uint64_t file_size = std::max(retval.m_file_size, sequence.back().last_file_offset);
+
+                if (writable) {
+                    for (const auto& [file_offset, sector] : sectors) {
+                        file->write_blocks(
+                            lclosed_interval<uint64_t>{ .min = file_offset / file_block_size, .max = (file_offset + sector.size()) / file_block_size }, sector.data()
+                        );
+                    }
+
+                    if (retval.m_file_size < file_size) {
+                        std::vector<std::byte> zero_block(file_block_size);
+                        file->write_blocks(file_size / file_block_size - 1, 1, zero_block.data());
+                    }
+                } else {
+                    file = std::make_unique<VhdxLogOverlay>(std::move(file), file_size / file_block_size, std::move(sectors));
+                }
+
+                retval.m_file_size = file_size;
+            }
+
+            if (writable) {
+                retval.m_file = std::move(file);
+                retval.m_file->flush();
+                retval.update_header(false);
+                file = std::move(retval.m_file);
+            }
+        }
+
+        // the region table has a backup copy
+        std::vector<std::byte> region_table_bytes;
+        for (auto offset : VHDX_REGION_TABLE_OFFSETS) {
+            auto bytes = read_file_bytes(*file, offset, VHDX_REGION_TABLE_SIZE);
+            auto layout = reinterpret_cast<const VhdxRegionTableLayout*>(bytes.data());
+            if (layout->signature == VHDX_REGION_TABLE_SIGNATURE &&
+                endian_load<uint32_t, std::endian::little>(layout->checksum) == vhdx_checksum(layout, VHDX_REGION_TABLE_SIZE, offsetof(VhdxRegionTableLayout, checksum)))
+            {
+                region_table_bytes = std::move(bytes);
+                break;
+            }
+        }
+
+        if (region_table_bytes.empty()) {
+            throw std::runtime_error("Bad VHDX: No valid region table.");
+        }
+
+        std::optional<lclosed_interval<uint64_t>> bat_region;
+        std::optional<lclosed_interval<uint64_t>> metadata_region;
+        {
+            auto region_table = reinterpret_cast<const VhdxRegionTableLayout*>(region_table_bytes.data());
+
+            uint32_t entry_count = endian_load<uint32_t, std::endian::little>(region_table->entry_count);
+            if (region_table->entries.size() < entry_count) {
+                throw std::runtime_error("Bad VHDX region table: `entry_count` exceeded.");
+            }
+
+            for (const auto& entry : std::span{ region_table->entries }.first(entry_count)) {
+                auto guid = entry.guid.load();
+                uint64_t file_offset = endian_load<uint64_t, std::endian::little>(entry.file_offset);
+                uint32_t length = endian_load<uint32_t, std::endian::little>(entry.length);
+                auto range = lclosed_interval<uint64_t>{ .min = file_offset, .max = file_offset + length };
+
+                if (guid == VHDX_BAT_REGION_GUID) {
+                    bat_region = range;
+                } else if (guid == VHDX_METADATA_REGION_GUID) {
+                    metadata_region = range;
+                } else if (endian_load<uint32_t, std::endian::little>(entry.flags) & 1) {
+                    throw std::runtime_error(std::format("Bad VHDX region table: Unknown required region {}.", guid));
+                }
+            }
+        }
+
+        if (!bat_region.has_value() || !metadata_region.has_value()) {
+            throw std::runtime_error("Bad VHDX region table: BAT or metadata region is missing.");
+        }
+
+        if (metadata_region->length() < VHDX_METADATA_TABLE_SIZE) {
+            throw std::runtime_error("Bad VHDX region table: Metadata region is too small.");
+        }
+
+        {
+            auto metadata_bytes = read_file_bytes(*file, metadata_region->min, VHDX_METADATA_TABLE_SIZE);
+            auto metadata_table = reinterpret_cast<const VhdxMetadataTableLayout*>(metadata_bytes.data());
+
+            if (!(metadata_table->signature == VHDX_METADATA_TABLE_SIGNATURE)) {
+                throw std::runtime_error("Bad VHDX metadata table: Invalid signature.");
+            }
+
+            uint16_t entry_count = endian_load<uint16_t, std::endian::little>(metadata_table->entry_count);
+            if (metadata_table->entries.size() < entry_count) {
+                throw std::runtime_error("Bad VHDX metadata table: `entry_count` exceeded.");
+            }
+
+            std::optional<uint32_t> payload_block_size;
+            std::optional<bool> has_parent;
+            std::optional<uint64_t> virtual_size;
+            std::optional<uint32_t> logical_sector_size;
+            std::optional<VirtualDiskParent> parent;
+
+            for (const auto& entry : std::span{ metadata_table->entries }.first(entry_count)) {
+                auto item_id = entry.item_id.load();
+                uint32_t offset = endian_load<uint32_t, std::endian::little>(entry.offset);
+                uint32_t length = endian_load<uint32_t, std::endian::little>(entry.length);
+                uint32_t flags = endian_load<uint32_t, std::endian::little>(entry.flags);
+
+                if (metadata_region->length() < static_cast<uint64_t>(offset) + length) {
+                    throw std::runtime_error(std::format("Bad VHDX metadata table: Item {} exceeds metadata region.", item_id));
+                }
+
+                auto read_item = [&](size_t expected_length) {
+                    if (length != expected_length) {
+                        throw std::runtime_error(std::format("Bad VHDX metadata table: Unexpected length of item {}.", item_id));
+                    }
+                    return read_file_bytes(*file, metadata_region->min + offset, length);
+                };
+
+                if (item_id == VHDX_FILE_PARAMETERS_GUID) {
+                    auto item = read_item(8);
+                    payload_block_size = endian_load<uint32_t, std::endian::little>(std::span<const std::byte, 4>{ item.data(), 4 });
+                    has_parent = (endian_load<uint32_t, std::endian::little>(std::span<const std::byte, 4>{ item.data() + 4, 4 }) & 2) != 0;
+                } else if (item_id == VHDX_VIRTUAL_DISK_SIZE_GUID) {
+                    auto item = read_item(8);
+                    virtual_size = endian_load<uint64_t, std::endian::little>(std::span<const std::byte, 8>{ item.data(), 8 });
+                } else if (item_id == VHDX_LOGICAL_SECTOR_SIZE_GUID) {
+                    auto item = read_item(4);
+                    logical_sector_size = endian_load<uint32_t, std::endian::little>(std::span<const std::byte, 4>{ item.data(), 4 });
+                } else if (item_id == VHDX_PARENT_LOCATOR_GUID) {
+                    parent = parse_parent_locator(read_file_bytes(*file, metadata_region->min + offset, length));
+                } else if (item_id == VHDX_VIRTUAL_DISK_ID_GUID || item_id == VHDX_PHYSICAL_SECTOR_SIZE_GUID) {
+                    // not needed for reading
+                } else if (flags & 4) {
+                    throw std::runtime_error(std::format("Bad VHDX metadata table: Unknown required item {}.", item_id));
+                }
+            }
+
+            if (!payload_block_size.has_value() || !virtual_size.has_value() || !logical_sector_size.has_value()) {
+                throw std::runtime_error("Bad VHDX metadata table: Required item is missing.");
+            }
+
+            if (has_parent.value()) {
+                if (!parent.has_value()) {
+                    throw std::runtime_error("Bad VHDX metadata table: Parent locator of differencing disk is missing.");
+                }
+
+                if (writable) {
+                    throw std::runtime_error("Differencing VHDX can only be opened read-only.");
+                }
+
+                retval.m_parent = std::move(parent);
+            }
+
+            // block size is a power of 2 in [1 MiB, 256 MiB]
+            if (!std::has_single_bit(payload_block_size.value()) || payload_block_size.value() < 1024 * 1024 || 256 * 1024 * 1024 < payload_block_size.value()) {
+                throw std::runtime_error(std::format("Bad VHDX metadata: Invalid block size 0x{:x}.", payload_block_size.value()));
+            }
+
+            if (logical_sector_size.value() != 512 && logical_sector_size.value() != 4096) {
+                throw std::runtime_error(std::format("Bad VHDX metadata: Invalid logical sector size {}.", logical_sector_size.value()));
+            }
+
+            if (virtual_size.value() % logical_sector_size.value() != 0) {
+                throw std::runtime_error("Bad VHDX metadata: Virtual disk size is not a multiple of logical sector size.");
+            }
+
+            if (logical_sector_size.value() % file->get_block_size() != 0) {
+                throw std::runtime_error("Bad VHDX: Logical sector size is not a multiple of block size of the file.");
+            }
+
+            retval.m_payload_block_size = payload_block_size.value();
+            retval.m_logical_sector_size = logical_sector_size.value();
+            retval.m_virtual_size = virtual_size.value();
+        }
+
+        {
+            uint64_t payload_blocks = (retval.m_virtual_size + retval.m_payload_block_size - 1) / retval.m_payload_block_size;
+            uint64_t chunk_ratio = (uint64_t{ 1 } << 23) * retval.m_logical_sector_size / retval.m_payload_block_size;
+
+            retval.m_bat = VhdxBat{ bat_region->min, chunk_ratio, payload_blocks };
+
+            // a differencing disk also has the sector bitmap entry of the last chunk
+            uint64_t raw_entry_count = retval.m_parent.has_value()
+                ? (payload_blocks + chunk_ratio - 1) / chunk_ratio * (chunk_ratio + 1)
+                : retval.m_bat.raw_entry_count();
+
+            if (bat_region->length() / 8 < raw_entry_count) {
+                throw std::runtime_error("Bad VHDX: BAT region is too small.");
+            }
+        }
+
+        retval.m_file = std::move(file);
+
+        return retval;
+    }
+}
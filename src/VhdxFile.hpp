@@ -0,0 +1,232 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "VirtualDisk.hpp"
+
+namespace vmgs {
+    enum class VhdxPayloadBlockState : uint8_t {
+        not_present = 0,
+        undefined = 1,
+        zero = 2,
+        unmapped = 3,
+        fully_present = 6,
+        partially_present = 7
+    };
+
+    struct VhdxBatEntry {
+        VhdxPayloadBlockState state;
+        uint64_t file_offset;   // in bytes, meaningful only for present blocks
+    };
+
+    // A run of virtual sectors whose data is either at one contiguous range of the file or not in the file at all.
+    struct VhdxExtent {
+        VhdxPayloadBlockState state;
+        uint64_t file_offset;   // in bytes
+        uint64_t length;        // in bytes
+    };
+
+    // The payload block entries of a VHDX BAT.
+    //
+    // Sector bitmap entries are skipped and every payload entry is packed into 32 bits, `file_offset >> 20` above the
+    // 3 state bits. Entries are loaded from the file in pages of `PAGE_ENTRIES` the first time they are looked up, so
+    // opening a disk and reading a few of its blocks costs memory and I/O in proportion to what is read, not to the
+    // virtual disk size.
+    //
+    // Updated entries are also patched into copies of their 4 KiB on-disk BAT sectors, which the owner commits through
+    // the VHDX log.
+    class VhdxBat {
+    public:
+        static constexpr uint64_t PAGE_ENTRIES = 512;
+        static constexpr size_t SECTOR_SIZE = 4096;
+
+    private:
+        uint64_t m_file_offset;     // of the BAT region
+        uint64_t m_chunk_ratio;     // payload entries between two sector bitmap entries
+        uint64_t m_entry_count;     // payload entries only
+        std::vector<std::unique_ptr<uint32_t[]>> m_pages;
+        std::map<uint64_t, std::vector<std::byte>> m_dirty_sectors;     // keyed by file offset
+
+        uint32_t* load_page(IBlockDevice& file, uint64_t page_index);
+
+    public:
+        VhdxBat() noexcept
+            : m_file_offset{}, m_chunk_ratio{}, m_entry_count{}, m_pages{}, m_dirty_sectors{} {}
+
+        VhdxBat(uint64_t file_offset, uint64_t chunk_ratio, uint64_t entry_count)
+            : m_file_offset{ file_offset },
+              m_chunk_ratio{ chunk_ratio },
+              m_entry_count{ entry_count },
+              m_pages((entry_count + PAGE_ENTRIES - 1) / PAGE_ENTRIES),
+              m_dirty_sectors{} {}
+
+        [[nodiscard]]
+        uint64_t entry_count() const noexcept {
+            return m_entry_count;
+        }
+
+        [[nodiscard]]
+        uint64_t chunk_ratio() const noexcept {
+            return m_chunk_ratio;
+        }
+
+        // number of entries in the on-disk BAT, sector bitmap entries included
+        [[nodiscard]]
+        uint64_t raw_entry_count() const noexcept {
+            return m_entry_count == 0 ? 0 : m_entry_count + (m_entry_count - 1) / m_chunk_ratio;
+        }
+
+        [[nodiscard]]
+        VhdxBatEntry lookup(IBlockDevice& file, uint64_t block_index);
+
+        // file offset of the sector bitmap block of chunk `chunk_index`, read from the file on every call;
+        // differencing disks only
+        [[nodiscard]]
+        std::optional<uint64_t> lookup_sector_bitmap(IBlockDevice& file, uint64_t chunk_index);
+
+        void update(IBlockDevice& file, uint64_t block_index, const VhdxBatEntry& entry);
+
+        [[nodiscard]]
+        std::map<uint64_t, std::vector<std::byte>> take_dirty_sectors() noexcept {
+            return std::exchange(m_dirty_sectors, {});
+        }
+    };
+
+    // A VHDX virtual disk, parsed in user space from the block device that holds the .vhdx file.
+    //
+    // Sectors a differencing disk does not have read as zeros; `VirtualDiskChain` fills them from the parent. The
+    // sector bitmaps of partially present blocks are loaded once per block.
+    //
+    // A non-empty log is replayed on open: into the file when it is writable, otherwise into an in-memory overlay.
+    // Writes to present blocks go straight to the file. Writes to other blocks allocate them at the end of the file;
+    // the BAT changes are kept in memory and committed by `flush`, as one log entry, followed by a single flush of the
+    // file, for all blocks allocated since the previous commit.
+    //
+    // See `[MS-VHDX]: Virtual Hard Disk v2 (VHDX) File Format`.
+    class VhdxFile : public IVirtualDisk {
+    public:
+        static constexpr uint64_t FILE_OFFSET_UNIT = 1024 * 1024;
+
+    private:
+        std::unique_ptr<IBlockDevice> m_file;
+        bool m_writable;
+        uint64_t m_file_size;               // in bytes, grows as payload blocks are allocated
+        uint32_t m_payload_block_size;
+        uint32_t m_logical_sector_size;
+        uint64_t m_virtual_size;
+        VhdxBat m_bat;
+        std::optional<VirtualDiskParent> m_parent;
+        std::unordered_map<uint64_t, std::vector<std::byte>> m_sector_bitmaps;     // keyed by payload block index
+
+        size_t m_header_index;              // of the current header
+        std::vector<std::byte> m_header;    // current header, as on disk
+
+        uint64_t m_log_offset;
+        uint64_t m_log_length;
+        uint64_t m_log_head;                // where the next log entry goes, relative to `m_log_offset`
+        uint64_t m_log_sequence_number;     // of the next log entry
+        bool m_log_open;                    // the current header carries a log GUID of ours
+
+        VhdxFile() noexcept
+            : m_file{},
+              m_writable{},
+              m_file_size{},
+              m_payload_block_size{},
+              m_logical_sector_size{},
+              m_virtual_size{},
+              m_bat{},
+              m_parent{},
+              m_sector_bitmaps{},
+              m_header_index{},
+              m_header{},
+              m_log_offset{},
+              m_log_length{},
+              m_log_head{},
+              m_log_sequence_number{},
+              m_log_open{} {}
+
+        // one bit per sector of the payload block, set if the sector is in the file
+        const std::vector<std::byte>& load_sector_bitmap(uint64_t block_index);
+
+        // writes the current header, with a new sequence number, to the location of the other one
+        void update_header(bool open_log);
+
+        void begin_write();
+
+        void commit_bat();
+
+    public:
+        VhdxFile(VhdxFile&& other) noexcept = default;
+
+        VhdxFile(const VhdxFile& other) = delete;
+
+        virtual ~VhdxFile() noexcept override;
+
+        VhdxFile& operator=(VhdxFile&& other) = delete;
+
+        VhdxFile& operator=(const VhdxFile& other) = delete;
+
+        [[nodiscard]]
+        virtual size_t get_block_size() const noexcept override {
+            return m_logical_sector_size;
+        }
+
+        [[nodiscard]]
+        virtual uint64_t get_block_count() const noexcept override {
+            return m_virtual_size / m_logical_sector_size;
+        }
+
+        [[nodiscard]]
+        uint32_t get_payload_block_size() const noexcept {
+            return m_payload_block_size;
+        }
+
+        [[nodiscard]]
+        uint64_t get_virtual_size() const noexcept {
+            return m_virtual_size;
+        }
+
+        // the data write GUID of the current header
+        [[nodiscard]]
+        virtual std::string get_linkage_id() const override;
+
+        [[nodiscard]]
+        virtual const std::optional<VirtualDiskParent>& get_parent() const noexcept override {
+            return m_parent;
+        }
+
+        [[nodiscard]]
+        virtual std::vector<VirtualDiskRun> map_runs(uint64_t lba, uint64_t n) override;
+
+        // Splits virtual sectors `[lba, lba + n)` into the fewest extents: adjacent runs are merged when their data
+        // is contiguous in the file, or when none of them is in the file. Extents are `fully_present`, `zero` or, in a
+        // differencing disk only, `not_present`.
+        [[nodiscard]]
+        std::vector<VhdxExtent> map_extents(uint64_t lba, uint64_t n);
+
+        virtual void read_blocks(uint64_t lba, uint32_t n, void* buf) override;
+
+        virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override;
+
+        virtual void flush() override;
+
+        // commits pending changes and empties the log
+        void close();
+
+        // whether `file` starts with the VHDX file identifier
+        [[nodiscard]]
+        static bool probe(IBlockDevice& file);
+
+        // `file` is the .vhdx file itself, e.g. a `UnixBlockDevice` opened on it.
+        // Differencing disks can only be opened read-only.
+        [[nodiscard]]
+        static VhdxFile open(std::unique_ptr<IBlockDevice>&& file, bool writable = false);
+    };
+}
@@ -0,0 +1,190 @@
+#include "VirtualDisk.hpp"
+
+#include <algorithm>
+#include <format>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+
+#include "VhdFile.hpp"
+#include "VhdxFile.hpp"
+
+namespace vmgs {
+    namespace {
+        [[nodiscard]]
+        std::unique_ptr<IVirtualDisk> open_level(const std::filesystem::path& path, bool writable, const VirtualDiskChain::opener_t& opener) {
+            auto file = opener(path, writable);
+
+            if (VhdxFile::probe(*file)) {
+                return std::make_unique<VhdxFile>(VhdxFile::open(std::move(file), writable));
+            } else if (VhdFile::probe(*file)) {
+                return std::make_unique<VhdFile>(VhdFile::open(std::move(file), writable));
+            } else {
+                throw std::runtime_error(std::format("Unrecognized virtual disk file `{}`, expect a VHDX or VHD file.", path.string()));
+            }
+        }
+
+        [[nodiscard]]
+        std::filesystem::path locate_parent(const std::filesystem::path& child_path, const VirtualDiskParent& parent, const VirtualDiskChain::exists_t& exists) {
+            auto child_dir = child_path.parent_path();
+
+            std::vector<std::filesystem::path> candidates;
+            for (auto stored : parent.paths) {
+#if !defined(WIN32)
+                std::ranges::replace(stored, u'\\', u'/');
+#endif
+                std::filesystem::path p{ stored };
+                candidates.push_back(p.is_absolute() ? p : child_dir / p);
+            }
+
+            // a chain copied off its host keeps the parent next to the child, while absolute paths point to the host
+            for (auto stored : parent.paths) {
+#if !defined(WIN32)
+                std::ranges::replace(stored, u'\\', u'/');
+#endif
+                candidates.push_back(child_dir / std::filesystem::path{ stored }.filename());
+            }
+
+            for (const auto& candidate : candidates) {
+                if (exists) {
+                    if (exists(candidate)) {
+                        return candidate;
+                    }
+                } else {
+                    std::error_code ec;
+                    if (std::filesystem::is_regular_file(candidate, ec)) {
+                        return candidate;
+                    }
+                }
+            }
+
+            throw std::runtime_error(std::format("Parent of differencing disk `{}` is not found.", child_path.string()));
+        }
+    }
+
+    void VirtualDiskChain::remember(uint64_t lba, uint64_t n, size_t level) {
+        if (MAX_CACHED_RUNS <= m_owners.size()) {
+            m_owners.clear();
+        }
+
+        uint64_t end = lba + n;
+
+        // runs are resolved for gaps of the cache only, so neighbours never overlap
+        auto next = m_owners.lower_bound(lba);
+        if (next != m_owners.end() && next->first == end && next->second.level == level) {
+            end = next->second.end;
+            next = m_owners.erase(next);
+        }
+
+        if (next != m_owners.begin()) {
+            auto prev = std::prev(next);
+            if (prev->second.end == lba && prev->second.level == level) {
+                prev->second.end = end;
+                return;
+            }
+        }
+
+        m_owners.emplace_hint(next, lba, OwnedRun{ .end = end, .level = level });
+    }
+
+    void VirtualDiskChain::read_blocks(uint64_t lba, uint32_t n, void* buf) {
+        if (get_block_count() < lba || get_block_count() - lba < n) {
+            throw std::out_of_range(std::format("Virtual disk access out of range: [0x{:x}, 0x{:x}).", lba, lba + n));
+        }
+
+        auto block_size = get_block_size();
+        auto p = static_cast<std::byte*>(buf);
+
+        std::vector<std::vector<BlockRequest>> requests(m_levels.size());
+
+        auto request = [&](uint64_t run_lba, uint64_t run_n, size_t level) {
+            requests[level].push_back(
+                BlockRequest{ .lba = run_lba, .n = static_cast<uint32_t>(run_n), .buf = p + (run_lba - lba) * block_size }
+            );
+        };
+
+        uint64_t end = lba + n;
+        for (uint64_t cur = lba; cur < end;) {
+            auto next = m_owners.upper_bound(cur);
+            if (next != m_owners.begin() && cur < std::prev(next)->second.end) {
+                auto& owned = std::prev(next)->second;
+                uint64_t count = std::min(owned.end, end) - cur;
+                request(cur, count, owned.level);
+                cur += count;
+                continue;
+            }
+
+            uint64_t gap_end = next == m_owners.end() ? end : std::min(end, next->first);
+
+            // walk the chain for the gap; the base disk owns whatever is left
+            std::vector<std::pair<uint64_t, uint64_t>> pending = { { cur, gap_end - cur } };
+            for (size_t level = 0; !pending.empty(); ++level) {
+                std::vector<std::pair<uint64_t, uint64_t>> inherited;
+                for (auto [run_lba, run_n] : pending) {
+                    for (const auto& run : m_levels[level]->map_runs(run_lba, run_n)) {
+                        if (run.inherited && level + 1 < m_levels.size()) {
+                            inherited.emplace_back(run_lba, run.n);
+                        } else {
+                            request(run_lba, run.n, level);
+                            remember(run_lba, run.n, level);
+                        }
+                        run_lba += run.n;
+                    }
+                }
+                pending = std::move(inherited);
+            }
+
+            cur = gap_end;
+        }
+
+        for (size_t level = 0; level < m_levels.size(); ++level) {
+            if (!requests[level].empty()) {
+                m_levels[level]->read_blocks(requests[level]);
+            }
+        }
+    }
+
+    void VirtualDiskChain::write_blocks(uint64_t, uint32_t, const void*) {
+        throw std::runtime_error("Differencing disk is opened read-only.");
+    }
+
+    std::unique_ptr<IBlockDevice> VirtualDiskChain::open(const std::filesystem::path& path, bool writable, const opener_t& opener, const exists_t& exists) {
+        auto disk = open_level(path, writable, opener);
+        if (!disk->get_parent().has_value()) {
+            return disk;
+        }
+
+        VirtualDiskChain retval;
+        retval.m_levels.push_back(std::move(disk));
+
+        auto child_path = path;
+        while (retval.m_levels.back()->get_parent().has_value()) {
+            if (MAX_DEPTH <= retval.m_levels.size()) {
+                throw std::runtime_error(std::format("Bad differencing chain: More than {} levels.", MAX_DEPTH));
+            }
+
+            const auto& child = *retval.m_levels.back();
+            const auto& parent = child.get_parent().value();
+
+            auto parent_path = locate_parent(child_path, parent, exists);
+            auto parent_disk = open_level(parent_path, false, opener);
+
+            if (parent_disk->get_linkage_id() != parent.linkage_id) {
+                throw std::runtime_error(
+                    std::format("Bad differencing chain: `{}` has changed since `{}` was created from it.", parent_path.string(), child_path.string())
+                );
+            }
+
+            if (parent_disk->get_block_size() != child.get_block_size() || parent_disk->get_block_count() != child.get_block_count()) {
+                throw std::runtime_error(
+                    std::format("Bad differencing chain: Geometry of `{}` differs from that of `{}`.", parent_path.string(), child_path.string())
+                );
+            }
+
+            retval.m_levels.push_back(std::move(parent_disk));
+            child_path = std::move(parent_path);
+        }
+
+        return std::make_unique<VirtualDiskChain>(std::move(retval));
+    }
+}
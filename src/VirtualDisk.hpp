@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "IBlockDevice.hpp"
+
+namespace vmgs {
+    // A run of sectors of a virtual disk that is either read from the disk itself or inherited from its parent.
+    struct VirtualDiskRun {
+        uint64_t n;         // in sectors
+        bool inherited;
+    };
+
+    // Where a differencing disk says its parent is.
+    struct VirtualDiskParent {
+        std::string linkage_id;             // `get_linkage_id()` of the parent when the child was created
+        std::vector<std::u16string> paths;  // as stored in the child, most preferred first
+    };
+
+    // A virtual disk file that may be a level of a differencing chain.
+    struct IVirtualDisk : IBlockDevice {
+        // A lowercase GUID that changes whenever the content of the disk changes.
+        [[nodiscard]]
+        virtual std::string get_linkage_id() const = 0;
+
+        [[nodiscard]]
+        virtual const std::optional<VirtualDiskParent>& get_parent() const noexcept = 0;
+
+        // Splits sectors `[lba, lba + n)` into runs. Inherited sectors read as zeros through the disk itself.
+        [[nodiscard]]
+        virtual std::vector<VirtualDiskRun> map_runs(uint64_t lba, uint64_t n) = 0;
+    };
+
+    // The merged, read-only view of a differencing chain.
+    //
+    // Which level owns a range of sectors is found by walking the chain from the child down once, and then kept in a
+    // cache of disjoint runs, so later reads of the range go straight to the owning level. A read is split into one
+    // scatter-gather request per level.
+    class VirtualDiskChain : public IBlockDevice {
+    public:
+        static constexpr size_t MAX_DEPTH = 64;
+        static constexpr size_t MAX_CACHED_RUNS = 64 * 1024;
+
+        // opens the file at `path`, e.g. as a `UnixBlockDevice` with 512-byte blocks
+        using opener_t = std::function<std::unique_ptr<IBlockDevice>(const std::filesystem::path& path, bool writable)>;
+
+        // tells whether `opener` can open the file at `path`; parent candidates are checked with it
+        using exists_t = std::function<bool(const std::filesystem::path& path)>;
+
+    private:
+        struct OwnedRun {
+            uint64_t end;
+            size_t level;
+        };
+
+        std::vector<std::unique_ptr<IVirtualDisk>> m_levels;    // the child first
+        std::map<uint64_t, OwnedRun> m_owners;                  // keyed by the first sector of each run
+
+        VirtualDiskChain() noexcept
+            : m_levels{}, m_owners{} {}
+
+        void remember(uint64_t lba, uint64_t n, size_t level);
+
+    public:
+        VirtualDiskChain(VirtualDiskChain&& other) noexcept = default;
+
+        VirtualDiskChain(const VirtualDiskChain& other) = delete;
+
+        VirtualDiskChain& operator=(VirtualDiskChain&& other) noexcept = default;
+
+        VirtualDiskChain& operator=(const VirtualDiskChain& other) = delete;
+
+        [[nodiscard]]
+        virtual size_t get_block_size() const override {
+            return m_levels.front()->get_block_size();
+        }
+
+        [[nodiscard]]
+        virtual uint64_t get_block_count() const override {
+            return m_levels.front()->get_block_count();
+        }
+
+        [[nodiscard]]
+        size_t get_depth() const noexcept {
+            return m_levels.size();
+        }
+
+        virtual void read_blocks(uint64_t lba, uint32_t n, void* buf) override;
+
+        virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override;
+
+        // Opens the VHDX or VHD file at `path`. A differencing disk is returned as the chain down to its base disk,
+        // whose parents are searched for next to their children when the stored paths do not exist.
+        // Without `exists`, a path exists if it is a regular file of the host filesystem.
+        [[nodiscard]]
+        static std::unique_ptr<IBlockDevice> open(const std::filesystem::path& path, bool writable, const opener_t& opener, const exists_t& exists = {});
+    };
+}
@@ -1,8 +1,14 @@
 #include "Vmgs.hpp"
 
 #include <array>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <limits>
 #include <ranges>
 #include <memory>
+#include <new>
+#include <optional>
 #include <string>
 #include <format>
 #include <stdexcept>
@@ -118,15 +124,13 @@ namespace vmgs {
         {
             uint32_t checksum_ = endian_load<uint32_t, std::endian::little>(checksum);
 
-            uint32_t expect_checksum = 0;
-            expect_checksum = crc32_iso3309(expect_checksum, signature);
-            expect_checksum = crc32_iso3309(expect_checksum, version);
-            expect_checksum = crc32_iso3309(expect_checksum, decltype(checksum){});
-            expect_checksum = crc32_iso3309(expect_checksum, sequence_number);
-            expect_checksum = crc32_iso3309(expect_checksum, header_size);
-            expect_checksum = crc32_iso3309(expect_checksum, locator_size);
-            expect_checksum = crc32_iso3309(expect_checksum, active_index);
-            expect_checksum = crc32_iso3309(expect_checksum, std::span{locators });
+            // the checksum field is summed as zeros
+            auto checksum_offset = offsetof(VmgsDataHeaderLayout, checksum);
+            auto rest_offset = checksum_offset + sizeof(checksum);
+
+            uint32_t expect_checksum = crc32_iso3309(0, this, checksum_offset);
+            expect_checksum = crc32_iso3309_zeros(expect_checksum, sizeof(checksum));
+            expect_checksum = crc32_iso3309(expect_checksum, reinterpret_cast<const std::byte*>(this) + rest_offset, sizeof(VmgsDataHeaderLayout) - rest_offset);
 
             if (expect_checksum != checksum_) {
                 throw std::runtime_error(std::format("Bad VMGS data header: Invalid checksum, expect 0x{:08x}, but got 0x{:08x}.", expect_checksum, checksum_));
@@ -161,24 +165,151 @@ namespace vmgs {
         }
     }
 
-    void VmgsData::store_to(IBlockDevice& partition_dev) const {
+    void VmgsData::store_header_to(IBlockDevice& partition_dev, size_t index) {
+        auto& header_block = m_header_blocks[index];
+
+        reinterpret_cast<VmgsDataHeaderLayout*>(header_block.data())->store(m_headers[index]);
+
+        partition_dev.write_blocks(index, 1, header_block.data());
+    }
+
+    void VmgsData::store_to(IBlockDevice& partition_dev) {
+        store_header_to(partition_dev, 0);
+        store_header_to(partition_dev, 1);
+    }
+
+    void VmgsData::enable_delta_writes(bool enabled) {
+        m_delta_writes = enabled;
+        if (!enabled) {
+            m_payload_snapshots.clear();
+        }
+    }
+
+    void VmgsData::remember_payload(std::span<const std::byte> data) {
+        if (m_delta_writes) {
+            m_payload_snapshots.insert_or_assign(active_header().active_locator().allocation_lba(), std::vector<std::byte>(data.begin(), data.end()));
+        }
+    }
+
+    void VmgsData::write_payload_blocks(IBlockDevice& partition_dev, uint64_t lba, std::span<const std::byte> data, std::span<const std::byte> padded_tail) {
         auto block_size = partition_dev.get_block_size();
-        auto lba_range = partition_dev.get_lba_range();
 
-        auto header0_block = std::make_unique<std::byte[]>(block_size);
-        auto header1_block = std::make_unique<std::byte[]>(block_size);
+        size_t full_size = data.size() / block_size * block_size;
+        size_t tail_size = data.size() - full_size;
+
+        std::vector<std::byte> tail_block;
+        if (tail_size != 0 && padded_tail.empty()) {
+            tail_block.resize(block_size, std::byte{});
+            std::ranges::copy(data.subspan(full_size), tail_block.begin());
+            padded_tail = tail_block;
+        }
+
+        // the block range [i, j) of the payload, with the tail block taken from `padded_tail`
+        auto write_run = [&](size_t i, size_t j) {
+            size_t run_end = std::min(j * block_size, full_size);
+            std::span<const std::byte> bufs[] = {
+                data.subspan(i * block_size, run_end - i * block_size),
+                j * block_size > full_size ? padded_tail : std::span<const std::byte>{}
+            };
+            partition_dev.writev_blocks(lba + i, bufs);
+        };
+
+        size_t block_num = full_size / block_size + (tail_size != 0 ? 1 : 0);
+
+        auto snapshot = m_delta_writes ? m_payload_snapshots.extract(lba) : decltype(m_payload_snapshots)::node_type{};
+        if (snapshot.empty()) {
+            write_run(0, block_num);
+        } else {
+            const auto& old_data = snapshot.mapped();
+
+            // A block can be skipped when its new bytes are a prefix of what it already holds: bytes past the new
+            // `data_size` are never read back.
+            auto block_unchanged = [&](size_t i) {
+                size_t offset = i * block_size;
+                size_t new_len = std::min(data.size() - offset, block_size);
+                size_t old_len = offset < old_data.size() ? std::min(old_data.size() - offset, block_size) : 0;
+                return new_len <= old_len && memcmp(data.data() + offset, old_data.data() + offset, new_len) == 0;
+            };
+
+            for (size_t i = 0; i < block_num;) {
+                if (block_unchanged(i)) {
+                    ++i;
+                } else {
+                    size_t j = i + 1;
+                    while (j < block_num && !block_unchanged(j)) {
+                        ++j;
+                    }
+                    write_run(i, j);
+                    i = j;
+                }
+            }
+        }
+
+        // the snapshot is dropped above, so a failed write leaves no stale copy behind
+        if (m_delta_writes) {
+            m_payload_snapshots.insert_or_assign(lba, std::vector<std::byte>(data.begin(), data.end()));
+        }
+    }
+
+    void VmgsData::write_payload(IBlockDevice& partition_dev, std::span<const std::byte> data, VmgsCommitMode mode) {
+        write_payload(partition_dev, data, std::span<const std::byte>{}, mode);
+    }
+
+    void VmgsData::write_payload(IBlockDevice& partition_dev, std::span<const std::byte> blocks, size_t data_size, VmgsCommitMode mode) {
+        auto block_size = partition_dev.get_block_size();
+
+        if (blocks.size() % block_size != 0 || blocks.size() < data_size || block_size <= blocks.size() - data_size) {
+            throw std::invalid_argument("Payload blocks must be the payload padded to the end of its last block.");
+        }
+
+        auto full_size = data_size / block_size * block_size;
+        auto padded_tail = full_size < data_size ? blocks.subspan(full_size, block_size) : std::span<const std::byte>{};
 
-        partition_dev.read_blocks(0, 1, header0_block.get());
-        partition_dev.read_blocks(1, 1, header1_block.get());
+        write_payload(partition_dev, blocks.first(data_size), padded_tail, mode);
+    }
+
+    void VmgsData::write_payload(IBlockDevice& partition_dev, std::span<const std::byte> data, std::span<const std::byte> padded_tail, VmgsCommitMode mode) {
+        auto block_size = partition_dev.get_block_size();
+        auto active_index = active_header_index();
 
-        auto header0_layout = reinterpret_cast<VmgsDataHeaderLayout*>(header0_block.get());
-        auto header1_layout = reinterpret_cast<VmgsDataHeaderLayout*>(header1_block.get());
+        // the header that is going to be written, and its content
+        size_t target_index;
+        VmgsDataHeader target_header = m_headers[active_index];
+
+        if (mode == VmgsCommitMode::ping_pong) {
+            if (target_header.m_sequence_number == std::numeric_limits<uint32_t>::max()) {
+                throw std::runtime_error("Bad VMGS: Sequence number is exhausted.");
+            }
+
+            auto live_range = target_header.active_locator().allocation_lba_range();
+            auto next_range = target_header.m_locators[1 - target_header.m_active_index].allocation_lba_range();
+            if (next_range.min < live_range.max && live_range.min < next_range.max) {
+                throw std::runtime_error("Bad VMGS: Allocations of two VMGS data locators overlap.");
+            }
+
+            target_index = 1 - active_index;
+            target_header.m_active_index = 1 - target_header.m_active_index;
+            target_header.m_sequence_number = target_header.m_sequence_number + 1;
+        } else {
+            target_index = active_index;
+        }
+
+        auto& target_locator = target_header.active_locator();
+
+        if (std::numeric_limits<uint32_t>::max() < data.size() || target_locator.allocation_num() * block_size < data.size()) {
+            throw std::runtime_error("New data size exceeds allocation range.");
+        }
+
+        write_payload_blocks(partition_dev, target_locator.allocation_lba(), data, padded_tail);
+
+        if (mode == VmgsCommitMode::ping_pong) {
+            partition_dev.flush();  // the payload must be durable before any header points to it
+        }
 
-        header0_layout->store(m_headers[0]);
-        header1_layout->store(m_headers[1]);
+        target_locator.update_data_size(static_cast<uint32_t>(data.size()), block_size);
 
-        partition_dev.write_blocks(0, 1, header0_block.get());
-        partition_dev.write_blocks(1, 1, header1_block.get());
+        m_headers[target_index] = target_header;
+        store_header_to(partition_dev, target_index);
     }
 
     VmgsData VmgsData::load_from(IBlockDevice& partition_dev) {
@@ -187,14 +318,23 @@ namespace vmgs {
         auto block_size = partition_dev.get_block_size();
         auto lba_range = partition_dev.get_lba_range();
 
-        auto header0_block = std::make_unique<std::byte[]>(block_size);
-        auto header1_block = std::make_unique<std::byte[]>(block_size);
+        auto& header0_block = retval.m_header_blocks[0];
+        auto& header1_block = retval.m_header_blocks[1];
 
-        partition_dev.read_blocks(0, 1, header0_block.get());
-        partition_dev.read_blocks(1, 1, header1_block.get());
+        header0_block.resize(block_size);
+        header1_block.resize(block_size);
 
-        auto header0_layout = reinterpret_cast<VmgsDataHeaderLayout*>(header0_block.get());
-        auto header1_layout = reinterpret_cast<VmgsDataHeaderLayout*>(header1_block.get());
+        {
+            BlockRequest requests[] = {
+                { .lba = 0, .n = 1, .buf = header0_block.data() },
+                { .lba = 1, .n = 1, .buf = header1_block.data() }
+            };
+
+            partition_dev.read_blocks(requests);
+        }
+
+        auto header0_layout = reinterpret_cast<VmgsDataHeaderLayout*>(header0_block.data());
+        auto header1_layout = reinterpret_cast<VmgsDataHeaderLayout*>(header1_block.data());
 
         retval.m_headers[0] = header0_layout->load(lba_range, block_size);
         retval.m_headers[1] = header1_layout->load(lba_range, block_size);
@@ -212,68 +352,214 @@ namespace vmgs {
 }
 
 #include "init.hpp"
+#include "VmgsJson.hpp"
+#include "CachingBlockDevice.hpp"
+#include "ReadAheadBlockDevice.hpp"
+#include "PartitionBlockDevice.hpp"
+#include "Gpt.hpp"
 
 #if defined(WIN32)
 #include "Win32BlockDevice.hpp"
 #include "VhdDisk.hpp"
-#include "VhdPartitionRef.hpp"
-#include "Gpt.hpp"
 #else
 #include "UnixBlockDevice.hpp"
+#include "UringBlockDevice.hpp"
+#include "MmapBlockDevice.hpp"
+#include "GzipBlockDevice.hpp"
+#include "StreamBlockDevice.hpp"
+#include "TarArchive.hpp"
+#include "VirtualDisk.hpp"
 #endif
 
 namespace vmgs {
+    // Exposes a mapped VMGS payload through the buffer protocol and keeps the mapping alive.
+    struct VmgsPayloadView {
+        std::shared_ptr<const std::byte> data;
+        size_t size;
+    };
+
+    struct VmgsOpenOptions {
+        bool writable = false;
+        bool mmap = false;
+        std::optional<size_t> block_size;   // logical block size of regular image files
+        bool direct = false;
+        bool uring = false;                 // serve batched reads of `dev` or `disk` with io_uring
+        size_t cache_size = 0;              // 0 disables the block cache
+        size_t open_window = 0;             // 0 disables the read-ahead window used while opening
+        VmgsCommitMode commit_mode = VmgsCommitMode::in_place;
+        bool delta = false;                 // only rewrite payload blocks that changed since the last read or write
+        std::optional<std::string> gzip_index;  // where the access point index of a gzip-compressed `disk` is kept
+        std::optional<std::string> member;      // a member of the tar archive given by `file` or `disk`
+    };
+
+    template<typename PyTy>
+    [[nodiscard]]
+    std::optional<PyTy> get_kwarg(const py::kwargs& kwargs, const char* name, std::string_view type_name) {
+        if (kwargs.contains(name)) {
+            auto obj = py::getattr(kwargs, "get")(name);
+            if (py::isinstance<PyTy>(obj)) {
+                return py::reinterpret_borrow<PyTy>(obj);
+            } else {
+                throw py::type_error(std::format("`{}` argument is not a instance of {} type.", name, type_name));
+            }
+        }
+        return std::nullopt;
+    }
+
     class VmgsIO {
+        public:
+            static constexpr size_t PAYLOAD_BUFFER_ALIGNMENT = 4096;
+
         private:
             std::unique_ptr<IBlockDevice> m_disk_dev;
             std::unique_ptr<IBlockDevice> m_partition_dev;
             std::unique_ptr<VmgsData> m_vmgs_data;
+            VmgsOpenOptions m_options;
 
-            VmgsIO(std::unique_ptr<IBlockDevice>&& partition_dev, std::unique_ptr<VmgsData>&& vmgs_data) noexcept
-                : m_disk_dev{}, m_partition_dev{ std::move(partition_dev) }, m_vmgs_data{ std::move(vmgs_data) } {}
+            VmgsIO(std::unique_ptr<IBlockDevice>&& partition_dev, std::unique_ptr<VmgsData>&& vmgs_data, const VmgsOpenOptions& options) noexcept
+                : m_disk_dev{}, m_partition_dev{ std::move(partition_dev) }, m_vmgs_data{ std::move(vmgs_data) }, m_options{ options } {}
 
-            VmgsIO(std::unique_ptr<IBlockDevice>&& disk_dev, std::unique_ptr<IBlockDevice>&& partition_dev, std::unique_ptr<VmgsData>&& vmgs_data) noexcept
-                : m_disk_dev{ std::move(disk_dev) }, m_partition_dev{ std::move(partition_dev) }, m_vmgs_data{ std::move(vmgs_data) } {}
+            VmgsIO(std::unique_ptr<IBlockDevice>&& disk_dev, std::unique_ptr<IBlockDevice>&& partition_dev, std::unique_ptr<VmgsData>&& vmgs_data, const VmgsOpenOptions& options) noexcept
+                : m_disk_dev{ std::move(disk_dev) }, m_partition_dev{ std::move(partition_dev) }, m_vmgs_data{ std::move(vmgs_data) }, m_options{ options } {}
 
         public:
             [[nodiscard]]
-            py::bytes read() {
+            py::object read(bool zero_copy) {
                 auto block_size = m_partition_dev->get_block_size();
                 const auto& active_locator = m_vmgs_data->active_header().active_locator();
 
-                size_t buf_n = (active_locator.data_size() + (block_size - 1)) / block_size;
-                size_t buf_size = buf_n * block_size;
+                size_t data_size = active_locator.data_size();
+                size_t full_n = data_size / block_size;
+                size_t tail_size = data_size % block_size;
+                size_t buf_n = full_n + (tail_size != 0 ? 1 : 0);
+
+                auto mapped = m_partition_dev->map_blocks(active_locator.allocation_lba(), buf_n);
+                if (mapped && zero_copy) {
+                    m_vmgs_data->remember_payload(std::span{ mapped.get(), data_size });
+                    return py::memoryview{ py::cast(VmgsPayloadView{ .data = std::move(mapped), .size = data_size }) };
+                }
+
+                auto retval = py::reinterpret_steal<py::bytes>(PyBytes_FromStringAndSize(nullptr, data_size));
+                if (!retval) {
+                    throw py::error_already_set();
+                }
+
+                auto retval_ptr = reinterpret_cast<std::byte*>(PyBytes_AS_STRING(retval.ptr()));
+
+                if (mapped) {
+                    memcpy(retval_ptr, mapped.get(), data_size);
+                } else {
+                    // full blocks land in the result directly, only the tail block goes through a bounce buffer
+                    std::vector<std::byte> tail_block(tail_size != 0 ? block_size : 0);
+
+                    // empty buffers are left out rather than passed as zero-length iovecs
+                    std::span<std::byte> bufs[2];
+                    size_t bufs_n = 0;
 
-                std::vector<std::byte> buf(buf_size, std::byte{});
-                m_partition_dev->read_blocks(active_locator.allocation_lba(), buf_n, buf.data());
+                    if (full_n != 0) {
+                        bufs[bufs_n++] = std::span{ retval_ptr, full_n * block_size };
+                    }
+
+                    if (tail_size != 0) {
+                        bufs[bufs_n++] = std::span{ tail_block };
+                    }
+
+                    if (bufs_n != 0) {
+                        m_partition_dev->readv_blocks(active_locator.allocation_lba(), std::span{ bufs }.first(bufs_n));
+                    }
+
+                    if (tail_size != 0) {
+                        memcpy(retval_ptr + full_n * block_size, tail_block.data(), tail_size);
+                    }
+                }
 
-                return py::bytes{ reinterpret_cast<char*>(buf.data()), active_locator.data_size() };
+                m_vmgs_data->remember_payload(std::span{ retval_ptr, data_size });
+
+                if (zero_copy) {
+                    return py::memoryview{ retval };
+                } else {
+                    return retval;
+                }
             }
 
-            void write(py::buffer buf) {
-                if (py::isinstance<py::bytes>(buf) || py::isinstance<py::bytearray>(buf) || py::isinstance<py::memoryview>(buf)) {
-                    auto buf_info = buf.request();
-                    assert(buf_info.itemsize == 1);
+            // Looks up one value of the payload without decoding the rest. `path` is either a string of member names
+            // and array indices separated by `/`, or a sequence of them.
+            [[nodiscard]]
+            py::object query(py::object path) {
+                auto to_u16string = [](py::handle s) {
+                    auto encoded = py::reinterpret_steal<py::bytes>(PyUnicode_AsEncodedString(s.ptr(), "utf-16-le", "surrogatepass"));
+                    if (!encoded) {
+                        throw py::error_already_set();
+                    }
+
+                    auto p = reinterpret_cast<const uint8_t*>(PyBytes_AS_STRING(encoded.ptr()));
+                    std::u16string retval(static_cast<size_t>(PyBytes_GET_SIZE(encoded.ptr())) / 2, u'\0');
+                    for (size_t i = 0; i < retval.size(); ++i) {
+                        retval[i] = static_cast<char16_t>(p[2 * i] | p[2 * i + 1] << 8);
+                    }
+                    return retval;
+                };
+
+                std::vector<std::u16string> steps;
+                if (py::isinstance<py::str>(path)) {
+                    auto stripped = path.attr("strip")("/");
+                    if (py::len(stripped) != 0) {
+                        for (auto step : stripped.attr("split")("/")) {
+                            steps.push_back(to_u16string(step));
+                        }
+                    }
+                } else if (py::isinstance<py::list>(path) || py::isinstance<py::tuple>(path)) {
+                    for (auto step : path) {
+                        if (py::isinstance<py::str>(step)) {
+                            steps.push_back(to_u16string(step));
+                        } else if (py::isinstance<py::int_>(step) && !py::isinstance<py::bool_>(step)) {
+                            steps.push_back(to_u16string(py::str(step)));
+                        } else {
+                            throw py::type_error("`path` argument must only have str and int steps.");
+                        }
+                    }
+                } else {
+                    throw py::type_error("`path` argument is not a instance of str/list/tuple type.");
+                }
 
-                    auto block_size = m_partition_dev->get_block_size();
-                    auto& active_locator = m_vmgs_data->active_header().active_locator();
+                auto block_size = m_partition_dev->get_block_size();
+                const auto& active_locator = m_vmgs_data->active_header().active_locator();
 
-                    if (buf_info.size <= std::numeric_limits<uint32_t>::max()) {
-                        uint32_t n = buf_info.size / block_size;
+                size_t data_size = active_locator.data_size();
+                size_t buf_n = (data_size + block_size - 1) / block_size;
 
-                        size_t direct_write_size = n * block_size;
-                        size_t indirect_write_size = buf_info.size - n * block_size;
+                std::vector<std::byte> blocks;
+                std::span<const std::byte> payload;
 
-                        m_partition_dev->write_blocks(active_locator.allocation_lba(), n, buf_info.ptr);
+                auto mapped = m_partition_dev->map_blocks(active_locator.allocation_lba(), buf_n);
+                if (mapped) {
+                    payload = std::span{ mapped.get(), data_size };
+                } else {
+                    blocks.resize(buf_n * block_size);
+                    m_partition_dev->read_blocks(
+                        lclosed_interval<uint64_t>{ .min = active_locator.allocation_lba(), .max = active_locator.allocation_lba() + buf_n }, blocks.data()
+                    );
+                    payload = std::span{ blocks }.first(data_size);
+                }
 
-                        std::vector<std::byte> single_block(block_size, std::byte{});
-                        m_partition_dev->read_blocks(active_locator.allocation_lba() + n, 1, single_block.data());
+                auto retval = vmgs_payload_query(payload, steps);
+                if (!retval.has_value()) {
+                    throw py::key_error(py::str(path).cast<std::string>());
+                }
+                return std::move(retval.value());
+            }
 
-                        memcpy(single_block.data(), reinterpret_cast<std::byte*>(buf_info.ptr) + direct_write_size, indirect_write_size);
-                        m_partition_dev->write_blocks(active_locator.allocation_lba() + n, 1, single_block.data());
+            void write(py::buffer buf) {
+                if (py::isinstance<py::bytes>(buf) || py::isinstance<py::bytearray>(buf) || py::isinstance<py::memoryview>(buf)) {
+                    auto buf_info = buf.request();
+                    assert(buf_info.itemsize == 1);
 
-                        active_locator.update_data_size(static_cast<uint32_t>(buf_info.size), block_size);
-                        m_vmgs_data->store_to(*m_partition_dev);
+                    if (buf_info.size <= std::numeric_limits<uint32_t>::max()) {
+                        m_vmgs_data->write_payload(
+                            *m_partition_dev,
+                            std::span{ static_cast<const std::byte*>(buf_info.ptr), static_cast<size_t>(buf_info.size) },
+                            m_options.commit_mode
+                        );
                     } else {
                         throw py::value_error("`buf` is too long.");
                     }
@@ -282,45 +568,348 @@ namespace vmgs {
                 }
             }
 
+            // Encodes `data` straight into a zero-padded buffer of whole blocks that is written as it is. The buffer is
+            // page-aligned, which suffices for direct I/O, so no block goes through a bounce buffer either.
+            void write_json(py::object data) {
+                auto block_size = m_partition_dev->get_block_size();
+
+                auto data_size = vmgs_encoded_size(data);
+                if (std::numeric_limits<uint32_t>::max() < data_size) {
+                    throw py::value_error("`data` is too long.");
+                }
+
+                auto blocks_size = (data_size + block_size - 1) / block_size * block_size;
+
+                auto deleter = [](std::byte* p) { ::operator delete[](p, std::align_val_t{ PAYLOAD_BUFFER_ALIGNMENT }); };
+                std::unique_ptr<std::byte[], decltype(deleter)> blocks{
+                    static_cast<std::byte*>(::operator new[](blocks_size, std::align_val_t{ PAYLOAD_BUFFER_ALIGNMENT })), deleter
+                };
+
+                vmgs_encode_to(data, std::span{ blocks.get(), data_size });
+                std::fill(blocks.get() + data_size, blocks.get() + blocks_size, std::byte{});
+
+                m_vmgs_data->write_payload(*m_partition_dev, std::span<const std::byte>{ blocks.get(), blocks_size }, data_size, m_options.commit_mode);
+            }
+
+            void flush() {
+                m_partition_dev->flush();
+            }
+
             void close() {
+                // read-only handles may not be flushable at all, e.g. FlushFileBuffers needs GENERIC_WRITE
+                if (m_partition_dev && m_options.writable) {
+                    m_partition_dev->flush();
+                }
+
                 m_partition_dev.reset();
                 m_disk_dev.reset();
             }
 
+            [[nodiscard]]
+            static VmgsIO from_disk(py::str path, const VmgsOpenOptions& options) {
+                if (options.block_size.has_value()) {
+                    throw py::value_error("`block_size` argument is not supported along with `file` argument.");
+                }
+
+                if (options.gzip_index.has_value()) {
+                    throw py::value_error("`gzip_index` argument is only supported along with `disk` argument.");
+                }
+
+                if (options.uring) {
+                    throw py::value_error("`uring` argument is only supported along with `dev` or `disk` argument.");
+                }
+
+#if defined(WIN32)
+                if (options.mmap || options.direct || options.member.has_value()) {
+                    throw py::not_implemented_error("`mmap`, `direct` and `member` argument are not supported on windows platform.");
+                }
+
+                auto vhd_disk = std::make_unique<VhdDisk>(VhdDisk::open(path.cast<std::wstring>()));
+                vhd_disk->attach();
+
+                std::unique_ptr<IBlockDevice> disk_dev = std::move(vhd_disk);
+#else
+                if (options.mmap) {
+                    if (options.direct) {
+                        throw py::value_error("`mmap` and `direct` argument conflicts.");
+                    }
+
+                    // a mapping cannot grow with the blocks that writes allocate
+                    if (options.writable) {
+                        throw py::value_error("`mmap` and `writable` argument conflicts for virtual disk files.");
+                    }
+                }
+
+                // also opens the parents of a differencing disk, which are never written
+                auto open_image = [&options](const std::filesystem::path& image_path, bool writable) -> std::unique_ptr<IBlockDevice> {
+                    std::unique_ptr<IBlockDevice> image;
+                    if (options.mmap) {
+                        image = std::make_unique<MmapBlockDevice>(MmapBlockDevice::open(image_path.string(), false));
+                    } else {
+                        image = std::make_unique<UnixBlockDevice>(
+                            UnixBlockDevice::open(image_path.string(), writable, UnixBlockDevice::DEFAULT_IMAGE_BLOCK_SIZE, options.direct)
+                        );
+                    }
+                    return open_if_gzip(std::move(image), image_path.string(), writable, UnixBlockDevice::DEFAULT_IMAGE_BLOCK_SIZE, std::nullopt, options);
+                };
+
+                std::unique_ptr<IBlockDevice> disk_dev;
+                if (options.member.has_value()) {
+                    if (options.writable) {
+                        throw py::value_error("`member` and `writable` argument conflicts for virtual disk files.");
+                    }
+
+                    // parents of a differencing member are other members, never host files
+                    auto archive = TarArchive::open(open_image(path.cast<std::string>(), false));
+                    disk_dev = VirtualDiskChain::open(
+                        options.member.value(),
+                        false,
+                        [&archive](const std::filesystem::path& member_path, bool) {
+                            return archive.open_member(member_path.lexically_normal().generic_string());
+                        },
+                        [&archive](const std::filesystem::path& member_path) {
+                            return archive.find(member_path.lexically_normal().generic_string()) != nullptr;
+                        }
+                    );
+                } else {
+                    disk_dev = VirtualDiskChain::open(path.cast<std::string>(), options.writable, open_image);
+                }
+#endif
+                return from_disk_device(std::move(disk_dev), options);
+            }
+
+            [[nodiscard]]
+            static VmgsIO from_raw_disk(py::str path, const VmgsOpenOptions& options) {
+#if defined(WIN32)
+                if (options.mmap || options.uring) {
+                    throw py::not_implemented_error("`mmap` and `uring` argument are not supported on windows platform.");
+                }
+
+                if (options.gzip_index.has_value() || options.member.has_value()) {
+                    throw py::not_implemented_error("`gzip_index` and `member` argument are not supported on windows platform.");
+                }
+
+                if (options.block_size.has_value() || options.direct) {
+                    throw py::not_implemented_error("`block_size` and `direct` argument are not supported on windows platform.");
+                }
+
+                std::unique_ptr<IBlockDevice> disk_dev =
+                    std::make_unique<Win32BlockDevice>(Win32BlockDevice::open(path.cast<std::wstring>(), options.writable));
+#else
+                std::unique_ptr<IBlockDevice> disk_dev;
+                if (options.mmap) {
+                    if (options.direct || options.uring) {
+                        throw py::value_error("`mmap` argument conflicts with `direct` and `uring` argument.");
+                    }
+
+                    disk_dev = std::make_unique<MmapBlockDevice>(
+                        MmapBlockDevice::open(path.cast<std::string>(), options.writable, options.block_size.value_or(MmapBlockDevice::DEFAULT_BLOCK_SIZE))
+                    );
+                } else if (options.uring) {
+                    if (options.direct) {
+                        throw py::value_error("`uring` and `direct` argument conflicts.");
+                    }
+
+                    disk_dev = std::make_unique<UringBlockDevice>(
+                        UringBlockDevice::open(path.cast<std::string>(), options.writable, options.block_size.value_or(UnixBlockDevice::DEFAULT_IMAGE_BLOCK_SIZE))
+                    );
+                } else {
+                    disk_dev = std::make_unique<UnixBlockDevice>(
+                        UnixBlockDevice::open(path.cast<std::string>(), options.writable, options.block_size.value_or(UnixBlockDevice::DEFAULT_IMAGE_BLOCK_SIZE), options.direct)
+                    );
+                }
+
+                disk_dev = open_if_gzip(
+                    std::move(disk_dev), path.cast<std::string>(), options.writable, options.block_size.value_or(GzipBlockDevice::DEFAULT_BLOCK_SIZE), options.gzip_index, options
+                );
+
+                // a tar archive is made of 512-byte blocks, and so are its members
+                if (options.member.has_value()) {
+                    if (options.block_size.has_value()) {
+                        throw py::value_error("`block_size` argument is not supported along with `member` argument.");
+                    }
+
+                    disk_dev = TarArchive::open(std::move(disk_dev)).open_member(options.member.value());
+                }
+#endif
+                return from_disk_device(std::move(disk_dev), options);
+            }
+
+#if !defined(WIN32)
+            // Reopens `image` as a `GzipBlockDevice` if it is gzip-compressed, which is only ever read from.
+            [[nodiscard]]
+            static std::unique_ptr<IBlockDevice> open_if_gzip(
+                std::unique_ptr<IBlockDevice>&& image,
+                const std::string& path,
+                bool writable,
+                size_t block_size,
+                const std::optional<std::string>& index_path,
+                const VmgsOpenOptions& options
+            ) {
+                if (!GzipBlockDevice::probe(*image)) {
+                    if (index_path.has_value()) {
+                        throw py::value_error("`gzip_index` argument is given, but the image is not gzip-compressed.");
+                    }
+                    return std::move(image);
+                }
+
+                if (writable) {
+                    throw py::value_error("`writable` argument is not supported for gzip-compressed images.");
+                }
+
+                if (options.direct) {
+                    throw py::value_error("`direct` argument is not supported for gzip-compressed images.");
+                }
+
+                // a gzip file can have any length, so it is read byte by byte
+                image.reset();
+
+                std::unique_ptr<IBlockDevice> file;
+                if (options.mmap) {
+                    file = std::make_unique<MmapBlockDevice>(MmapBlockDevice::open(path, false, 1));
+                } else {
+                    file = std::make_unique<UnixBlockDevice>(UnixBlockDevice::open(path, false, 1));
+                }
+
+                std::optional<std::filesystem::path> gzip_index;
+                if (index_path.has_value()) {
+                    gzip_index = index_path.value();
+                }
+
+                return std::make_unique<GzipBlockDevice>(GzipBlockDevice::open(std::move(file), block_size, gzip_index));
+            }
+#endif
+
+            // reads a whole disk from a pipe or any other file descriptor that can only be read forward
+            [[nodiscard]]
+            static VmgsIO from_stream(int fd, const VmgsOpenOptions& options) {
 #if defined(WIN32)
+                throw py::not_implemented_error("`stream` argument is not supported on windows platform.");
+#else
+                if (options.writable) {
+                    throw py::value_error("`stream` and `writable` argument conflicts.");
+                }
+
+                if (options.mmap || options.direct || options.uring || options.gzip_index.has_value() || options.member.has_value()) {
+                    throw py::value_error("`mmap`, `direct`, `uring`, `gzip_index` and `member` argument are not supported along with `stream` argument.");
+                }
+
+                std::unique_ptr<IBlockDevice> disk_dev = std::make_unique<StreamBlockDevice>(
+                    StreamBlockDevice::open(fd, options.block_size.value_or(StreamBlockDevice::DEFAULT_BLOCK_SIZE))
+                );
+
+                // a read-ahead window could run past the end of the stream, whose length is unknown
+                auto stream_options = options;
+                stream_options.open_window = 0;
+
+                return from_disk_device(std::move(disk_dev), stream_options);
+#endif
+            }
+
+            // looks up the VMGS partition in the GPT of a whole disk
             [[nodiscard]]
-            static VmgsIO from_disk(py::str path) {
+            static VmgsIO from_disk_device(std::unique_ptr<IBlockDevice>&& disk_dev, const VmgsOpenOptions& options) {
                 constexpr GptGuid VMGS_PARTITION_TYPE_GUID =
                     { 0x700f0c12, 0x1515, 0x4e4d, { 0x8d, 0x32, 0x53, 0xf6, 0x85, 0xbf, 0x44, 0xaf } };
 
-                auto disk_dev = std::make_unique<VhdDisk>(VhdDisk::open(path.cast<std::wstring>()));
-                disk_dev->attach();
+                ReadAheadBlockDevice* open_window = nullptr;
+                if (0 < options.open_window) {
+                    auto read_ahead = std::make_unique<ReadAheadBlockDevice>(std::move(disk_dev), options.open_window);
+                    open_window = read_ahead.get();
+                    disk_dev = std::move(read_ahead);
+                }
 
-                auto disk_gpt = Gpt::load_from(*disk_dev);
+                // the VMGS partition is usually the first entry, so the rest of the table is not read unless we are going to
+                // write through the bounds of the entry
+                auto partition_table = GptPartitionTable::load_from(*disk_dev);
+                auto partition = partition_table.find_by_type(VMGS_PARTITION_TYPE_GUID);
+                if (!partition.has_value()) {
+                    throw std::runtime_error("Bad VMGS: VMGS partition is not found.");
+                }
 
-                for (const auto& partition : disk_gpt.partitions()) {
-                    if (partition.type_guid() == VMGS_PARTITION_TYPE_GUID) {
-                        auto partition_dev = std::make_unique<VhdPartitionRef>(*disk_dev, partition);
-                        auto vmgs_data = std::make_unique<VmgsData>(VmgsData::load_from(*partition_dev));
-                        return VmgsIO{ std::move(disk_dev), std::move(partition_dev), std::move(vmgs_data) };
-                    }
+                if (options.writable) {
+                    partition_table.verify();
+                }
+
+                std::unique_ptr<IBlockDevice> partition_dev = std::make_unique<PartitionBlockDevice>(*disk_dev, partition.value());
+                if (0 < options.cache_size) {
+                    partition_dev = std::make_unique<CachingBlockDevice>(std::move(partition_dev), options.cache_size);
                 }
 
-                throw std::runtime_error("Bad VMGS: VMGS partition is not found.");
+                auto vmgs_data = std::make_unique<VmgsData>(VmgsData::load_from(*partition_dev));
+                vmgs_data->enable_delta_writes(options.delta);
+
+                // the window is only meant for opening
+                if (open_window) {
+                    open_window->discard();
+                }
+                return VmgsIO{ std::move(disk_dev), std::move(partition_dev), std::move(vmgs_data), options };
             }
-#endif
 
             [[nodiscard]]
-            static VmgsIO from_partition(py::str path, bool writable) {
+            static VmgsIO from_partition(py::str path, const VmgsOpenOptions& options) {
+                if (options.gzip_index.has_value()) {
+                    throw py::value_error("`gzip_index` argument is only supported along with `disk` argument.");
+                }
+
+                if (options.member.has_value()) {
+                    throw py::value_error("`member` argument is only supported along with `file` or `disk` argument.");
+                }
+
 #if defined(WIN32)
-                auto partition_dev =
-                    std::make_unique<Win32BlockDevice>(Win32BlockDevice::open(path.cast<std::wstring>(), writable));
+                if (options.mmap || options.uring) {
+                    throw py::not_implemented_error("`mmap` and `uring` argument are not supported on windows platform.");
+                }
+
+                if (options.block_size.has_value() || options.direct) {
+                    throw py::not_implemented_error("`block_size` and `direct` argument are not supported on windows platform.");
+                }
+
+                std::unique_ptr<IBlockDevice> partition_dev =
+                    std::make_unique<Win32BlockDevice>(Win32BlockDevice::open(path.cast<std::wstring>(), options.writable));
 #else
-                auto partition_dev =
-                    std::make_unique<UnixBlockDevice>(UnixBlockDevice::open(path.cast<std::string>(), writable));
+                std::unique_ptr<IBlockDevice> partition_dev;
+                if (options.mmap) {
+                    if (options.direct || options.uring) {
+                        throw py::value_error("`mmap` argument conflicts with `direct` and `uring` argument.");
+                    }
+
+                    partition_dev = std::make_unique<MmapBlockDevice>(
+                        MmapBlockDevice::open(path.cast<std::string>(), options.writable, options.block_size.value_or(MmapBlockDevice::DEFAULT_BLOCK_SIZE))
+                    );
+                } else if (options.uring) {
+                    if (options.direct) {
+                        throw py::value_error("`uring` and `direct` argument conflicts.");
+                    }
+
+                    partition_dev = std::make_unique<UringBlockDevice>(
+                        UringBlockDevice::open(path.cast<std::string>(), options.writable, options.block_size.value_or(UnixBlockDevice::DEFAULT_IMAGE_BLOCK_SIZE))
+                    );
+                } else {
+                    partition_dev = std::make_unique<UnixBlockDevice>(
+                        UnixBlockDevice::open(path.cast<std::string>(), options.writable, options.block_size.value_or(UnixBlockDevice::DEFAULT_IMAGE_BLOCK_SIZE), options.direct)
+                    );
+                }
 #endif
+                ReadAheadBlockDevice* open_window = nullptr;
+                if (0 < options.open_window) {
+                    auto read_ahead = std::make_unique<ReadAheadBlockDevice>(std::move(partition_dev), options.open_window);
+                    open_window = read_ahead.get();
+                    partition_dev = std::move(read_ahead);
+                }
+
+                if (0 < options.cache_size) {
+                    partition_dev = std::make_unique<CachingBlockDevice>(std::move(partition_dev), options.cache_size);
+                }
+
                 auto vmgs_data = std::make_unique<VmgsData>(VmgsData::load_from(*partition_dev));
-                return VmgsIO{ std::move(partition_dev), std::move(vmgs_data) };
+                vmgs_data->enable_delta_writes(options.delta);
+
+                // the window is only meant for opening
+                if (open_window) {
+                    open_window->discard();
+                }
+                return VmgsIO{ std::move(partition_dev), std::move(vmgs_data), options };
             }
     };
 
@@ -336,61 +925,103 @@ namespace vmgs {
         }
 
         virtual void declare(py::module_& m) override {
+            py::class_<VmgsPayloadView>{ m, "VmgsPayloadView", py::buffer_protocol() };
             binding_t{ m, "VmgsIO" };
         }
 
         virtual void make_binding(py::module_& m) override {
+            m.attr("VmgsPayloadView").cast<py::class_<VmgsPayloadView>>()
+                .def_buffer(
+                    [](VmgsPayloadView& self) -> py::buffer_info {
+                        return py::buffer_info{
+                            const_cast<std::byte*>(self.data.get()), 1, py::format_descriptor<uint8_t>::format(), 1,
+                            { static_cast<py::ssize_t>(self.size) }, { static_cast<py::ssize_t>(1) }, true
+                        };
+                    }
+                );
+
             m.attr("VmgsIO").cast<binding_t>()
                 .def(py::init(
                     [](py::kwargs kwargs) -> VmgsIO {
-                        std::optional<py::str> dev;
-                        std::optional<py::str> file;
-                        std::optional<py::bool_> writable;
-
-                        if (kwargs.contains("dev")) {
-                            auto obj = py::getattr(kwargs, "get")("dev");
-                            if (py::isinstance<py::str>(obj)) {
-                                dev = py::reinterpret_borrow<py::str>(obj);
-                            } else {
-                                throw py::type_error("`dev` argument is not a instance of str type.");
-                            }
+                        auto dev = get_kwarg<py::str>(kwargs, "dev", "str");
+                        auto file = get_kwarg<py::str>(kwargs, "file", "str");
+                        auto disk = get_kwarg<py::str>(kwargs, "disk", "str");
+                        auto stream = get_kwarg<py::int_>(kwargs, "stream", "int");
+
+                        VmgsOpenOptions options;
+
+                        if (auto writable = get_kwarg<py::bool_>(kwargs, "writable", "bool")) {
+                            options.writable = static_cast<bool>(writable.value());
                         }
 
-                        if (kwargs.contains("file")) {
-                            auto obj = py::getattr(kwargs, "get")("file");
-                            if (py::isinstance<py::str>(obj)) {
-                                file = py::reinterpret_borrow<py::str>(obj);
-                            } else {
-                                throw py::type_error("`file` argument is not a instance of str type.");
-                            }
+                        if (auto mmap = get_kwarg<py::bool_>(kwargs, "mmap", "bool")) {
+                            options.mmap = static_cast<bool>(mmap.value());
+                        }
+
+                        if (auto block_size = get_kwarg<py::int_>(kwargs, "block_size", "int")) {
+                            options.block_size = block_size.value().cast<size_t>();
                         }
 
-                        if (kwargs.contains("writable")) {
-                            auto obj = py::getattr(kwargs, "get")("writable");
-                            if (py::isinstance<py::bool_>(obj)) {
-                                writable = py::reinterpret_borrow<py::bool_>(obj);
+                        if (auto direct = get_kwarg<py::bool_>(kwargs, "direct", "bool")) {
+                            options.direct = static_cast<bool>(direct.value());
+                        }
+
+                        if (auto uring = get_kwarg<py::bool_>(kwargs, "uring", "bool")) {
+                            options.uring = static_cast<bool>(uring.value());
+                        }
+
+                        if (auto cache_size = get_kwarg<py::int_>(kwargs, "cache_size", "int")) {
+                            options.cache_size = cache_size.value().cast<size_t>();
+                        }
+
+                        if (auto open_window = get_kwarg<py::int_>(kwargs, "open_window", "int")) {
+                            options.open_window = open_window.value().cast<size_t>();
+                        }
+
+                        if (auto delta = get_kwarg<py::bool_>(kwargs, "delta", "bool")) {
+                            options.delta = static_cast<bool>(delta.value());
+                        }
+
+                        if (auto gzip_index = get_kwarg<py::str>(kwargs, "gzip_index", "str")) {
+                            options.gzip_index = gzip_index.value().cast<std::string>();
+                        }
+
+                        if (auto member = get_kwarg<py::str>(kwargs, "member", "str")) {
+                            options.member = member.value().cast<std::string>();
+                        }
+
+                        if (auto commit = get_kwarg<py::str>(kwargs, "commit", "str")) {
+                            auto commit_ = commit.value().cast<std::string>();
+                            if (commit_ == "in_place") {
+                                options.commit_mode = VmgsCommitMode::in_place;
+                            } else if (commit_ == "ping_pong") {
+                                options.commit_mode = VmgsCommitMode::ping_pong;
                             } else {
-                                throw py::type_error("`writable` argument is not a instance of bool type.");
+                                throw py::value_error("`commit` argument must be either \"in_place\" or \"ping_pong\".");
                             }
                         }
 
-                        if (!dev.has_value() && !file.has_value()) {
-                            throw py::value_error("Missing `dev` or `file` argument.");
-                        } else if (dev.has_value() && !file.has_value()) {
-                            return VmgsIO::from_partition(dev.value(), writable.has_value() ? static_cast<bool>(writable.value()) : false);
-                        } else if (!dev.has_value() && file.has_value()) {
-#if defined(WIN32)
-                            return VmgsIO::from_disk(file.value());
-#else
-                            throw py::not_implemented_error("`file` arguemnt is not supported on non-windows platform.");
-#endif
+                        int given = dev.has_value() + file.has_value() + disk.has_value() + stream.has_value();
+                        if (given == 0) {
+                            throw py::value_error("Missing `dev`, `file`, `disk` or `stream` argument.");
+                        } else if (1 < given) {
+                            throw py::value_error("`dev`, `file`, `disk` and `stream` argument conflict with each other.");
+                        } else if (dev.has_value()) {
+                            return VmgsIO::from_partition(dev.value(), options);
+                        } else if (file.has_value()) {
+                            return VmgsIO::from_disk(file.value(), options);
+                        } else if (disk.has_value()) {
+                            return VmgsIO::from_raw_disk(disk.value(), options);
                         } else {
-                            throw py::value_error("`dev` and `file` argument conflicts.");
+                            return VmgsIO::from_stream(stream.value().cast<int>(), options);
                         }
                     }
                 ))
-                .def("read", &VmgsIO::read)
+                .def("read", &VmgsIO::read, py::arg("zero_copy") = false)
+                .def("query", &VmgsIO::query, py::arg("path"))
                 .def("write", &VmgsIO::write)
+                .def("write_json", &VmgsIO::write_json, py::arg("data"))
+                .def("flush", &VmgsIO::flush)
                 .def("close", &VmgsIO::close)
                 .def("__enter__",
                     [](VmgsIO& self) -> VmgsIO& {
@@ -2,6 +2,10 @@
 #include <cstddef>
 #include <cstdint>
 
+#include <span>
+#include <unordered_map>
+#include <vector>
+
 #include "interval.hpp"
 #include "IBlockDevice.hpp"
 
@@ -75,22 +79,71 @@ namespace vmgs {
         }
     };
 
+    enum class VmgsCommitMode {
+        // overwrite the active locator's allocation, then rewrite the active header
+        in_place,
+        // write into the inactive locator's allocation, flush once, then publish it through the non-active header
+        ping_pong
+    };
+
     class VmgsData {
     private:
         VmgsDataHeader m_headers[2];
 
+        // header blocks as last read from / written to the partition, so that storing a header needs no read
+        std::vector<std::byte> m_header_blocks[2];
+
+        // payloads as last read from / written to each allocation, keyed by allocation LBA; only kept for delta writes
+        bool m_delta_writes = false;
+        std::unordered_map<uint64_t, std::vector<std::byte>> m_payload_snapshots;
+
+        // `padded_tail` is the last, partial block of `data` padded with zeros, or empty to have it copied and padded
+        void write_payload_blocks(IBlockDevice& partition_dev, uint64_t lba, std::span<const std::byte> data, std::span<const std::byte> padded_tail);
+
+        void write_payload(IBlockDevice& partition_dev, std::span<const std::byte> data, std::span<const std::byte> padded_tail, VmgsCommitMode mode);
+
     public:
+        [[nodiscard]]
+        size_t active_header_index() const noexcept {
+            return m_headers[0].m_sequence_number > m_headers[1].m_sequence_number ? 0 : 1;
+        }
+
         [[nodiscard]]
         VmgsDataHeader& active_header() noexcept {
-            return m_headers[0].m_sequence_number > m_headers[1].m_sequence_number ? m_headers[0] : m_headers[1];
+            return m_headers[active_header_index()];
         }
 
         [[nodiscard]]
         const VmgsDataHeader& active_header() const noexcept {
-            return m_headers[0].m_sequence_number > m_headers[1].m_sequence_number ? m_headers[0] : m_headers[1];
+            return m_headers[active_header_index()];
         }
 
-        void store_to(IBlockDevice& partition_dev) const;
+        // writes the header at `index` to its block
+        void store_header_to(IBlockDevice& partition_dev, size_t index);
+
+        void store_to(IBlockDevice& partition_dev);
+
+        // When enabled, `write_payload` compares the new payload block by block with the last known content of the
+        // target allocation and only rewrites the blocks that changed.
+        void enable_delta_writes(bool enabled);
+
+        // Records `data` as the current payload of the active locator, e.g. right after it has been read.
+        void remember_payload(std::span<const std::byte> data);
+
+        // Replaces the payload, touching as few blocks as possible:
+        //   1. the payload goes out as one vectored request, with the tail block zero-padded instead of read back;
+        //   2. only one header is rewritten.
+        //
+        // With `VmgsCommitMode::ping_pong`, the payload goes into the allocation of the active header's inactive locator
+        // and the partition is flushed once before the non-active header is rewritten as a copy of the active one with
+        // `active_index` flipped and `sequence_number` bumped. Live data is never overwritten, so a crash at any point
+        // leaves either the old or the new payload active. The trailing header write is not flushed, which lets callers
+        // batch many updates per sync.
+        void write_payload(IBlockDevice& partition_dev, std::span<const std::byte> data, VmgsCommitMode mode = VmgsCommitMode::in_place);
+
+        // Same as above, but the payload is the first `data_size` bytes of `blocks`, whose size is a multiple of block
+        // size and whose bytes past the payload are zeros, so the blocks are written straight from `blocks`.
+        void write_payload(IBlockDevice& partition_dev, std::span<const std::byte> blocks, size_t data_size, VmgsCommitMode mode = VmgsCommitMode::in_place);
 
         [[nodiscard]]
         static VmgsData load_from(IBlockDevice& partition_dev);
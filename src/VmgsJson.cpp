@@ -0,0 +1,1305 @@
+#include "VmgsJson.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "init.hpp"
+
+namespace vmgs {
+    namespace {
+        [[nodiscard]]
+        char16_t load_unit(const uint8_t* p) noexcept {
+            return static_cast<char16_t>(p[0] | p[1] << 8);
+        }
+
+        // Whether the 8 code units at `p` are all ASCII and none is NUL; if so, they are stored to `out` as 8 bytes.
+        [[nodiscard]]
+        bool transcode_ascii_block(const uint8_t* p, char* out) noexcept {
+#if defined(_M_X64) || defined(__x86_64__)
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            auto is_ascii = _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xff80))), _mm_setzero_si128());
+            auto is_nul = _mm_cmpeq_epi16(v, _mm_setzero_si128());
+            if (_mm_movemask_epi8(_mm_andnot_si128(is_nul, is_ascii)) != 0xffff) {
+                return false;
+            }
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(v, v));
+            return true;
+#elif defined(_M_ARM64) || defined(__aarch64__)
+            auto v = vreinterpretq_u16_u8(vld1q_u8(p));
+            if (0x80 <= vmaxvq_u16(v) || vminvq_u16(v) == 0) {
+                return false;
+            }
+
+            vst1_u8(reinterpret_cast<uint8_t*>(out), vmovn_u16(v));
+            return true;
+#else
+            for (size_t i = 0; i < 8; ++i) {
+                auto c = load_unit(p + 2 * i);
+                if (c == 0 || 0x80 <= c) {
+                    return false;
+                }
+            }
+
+            for (size_t i = 0; i < 8; ++i) {
+                out[i] = static_cast<char>(p[2 * i]);
+            }
+            return true;
+#endif
+        }
+    }
+
+    std::string vmgs_payload_to_utf8(std::span<const std::byte> payload) {
+        auto p = reinterpret_cast<const uint8_t*>(payload.data());
+        auto units = payload.size() / 2;
+
+        size_t i = 0;
+        while (i < units && load_unit(p + 2 * i) == 0) {
+            ++i;
+        }
+
+        // at most 3 bytes per code unit, a surrogate pair takes 4 bytes for 2 units
+        std::string retval((units - i) * 3, '\0');
+        auto out = retval.data();
+
+        bool terminated = false;
+        while (i < units) {
+            for (; i + 8 <= units && transcode_ascii_block(p + 2 * i, out); i += 8) {
+                out += 8;
+            }
+
+            if (i == units) {
+                break;
+            }
+
+            // one code unit at a time, until the next block
+            auto c = load_unit(p + 2 * i);
+            if (c == 0) {
+                terminated = true;
+                break;
+            } else if (c < 0x80) {
+                *out++ = static_cast<char>(c);
+                i += 1;
+            } else if (c < 0x800) {
+                *out++ = static_cast<char>(0xc0 | c >> 6);
+                *out++ = static_cast<char>(0x80 | (c & 0x3f));
+                i += 1;
+            } else if (c < 0xd800 || 0xe000 <= c) {
+                *out++ = static_cast<char>(0xe0 | c >> 12);
+                *out++ = static_cast<char>(0x80 | (c >> 6 & 0x3f));
+                *out++ = static_cast<char>(0x80 | (c & 0x3f));
+                i += 1;
+            } else {
+                auto c2 = i + 1 < units ? load_unit(p + 2 * (i + 1)) : char16_t{};
+                if (0xdc00 <= c || c2 < 0xdc00 || 0xe000 <= c2) {
+                    throw std::invalid_argument(std::format("Bad VMGS payload: Unpaired surrogate at code unit {:d}.", i));
+                }
+
+                char32_t cp = 0x10000 + ((static_cast<char32_t>(c) - 0xd800) << 10 | (static_cast<char32_t>(c2) - 0xdc00));
+                *out++ = static_cast<char>(0xf0 | cp >> 18);
+                *out++ = static_cast<char>(0x80 | (cp >> 12 & 0x3f));
+                *out++ = static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+                *out++ = static_cast<char>(0x80 | (cp & 0x3f));
+                i += 2;
+            }
+        }
+
+        if (!terminated && payload.size() % 2 != 0) {
+            throw std::invalid_argument("Bad VMGS payload: Truncated UTF-16 text.");
+        }
+
+        retval.resize(out - retval.data());
+        return retval;
+    }
+
+    namespace {
+        struct JsonBlockMasks {
+            uint64_t backslashes;
+            uint64_t quotes;
+            uint64_t operators;     // { } [ ] , :
+        };
+
+        // One bit per code unit of a block of 64 code units.
+        [[nodiscard]]
+        JsonBlockMasks classify_json_block(const uint8_t* p) noexcept {
+            JsonBlockMasks retval{};
+#if defined(_M_X64) || defined(__x86_64__)
+            for (size_t k = 0; k < 4; ++k) {
+                // 16 code units to 16 bytes; units above 0xff saturate to 0xff or 0, neither of which is structural
+                auto v = _mm_packus_epi16(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32 * k)),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32 * k + 16))
+                );
+
+                auto eq = [v](char c) {
+                    return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+                };
+
+                auto bits = [](__m128i m) {
+                    return static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(m)));
+                };
+
+                auto operators = _mm_or_si128(
+                    _mm_or_si128(_mm_or_si128(eq('{'), eq('}')), _mm_or_si128(eq('['), eq(']'))),
+                    _mm_or_si128(eq(','), eq(':'))
+                );
+
+                retval.backslashes |= bits(eq('\\')) << (16 * k);
+                retval.quotes |= bits(eq('"')) << (16 * k);
+                retval.operators |= bits(operators) << (16 * k);
+            }
+#else
+            for (size_t i = 0; i < 64; ++i) {
+                auto c = load_unit(p + 2 * i);
+                auto bit = uint64_t{ 1 } << i;
+                if (c == '\\') {
+                    retval.backslashes |= bit;
+                } else if (c == '"') {
+                    retval.quotes |= bit;
+                } else if (c == '{' || c == '}' || c == '[' || c == ']' || c == ',' || c == ':') {
+                    retval.operators |= bit;
+                }
+            }
+#endif
+            return retval;
+        }
+
+        // Stage 1 of simdjson, over UTF-16LE: per block of 64 code units, the quotes that are not escaped are found
+        // from the backslashes, the code units inside strings are masked with a prefix XOR of those quotes, and what
+        // remains of the operators, along with the opening quotes, are the structural characters. Blocks are
+        // classified only as far as the caller reads.
+        class JsonStructuralIterator {
+        public:
+            static constexpr size_t npos = static_cast<size_t>(-1);
+
+        private:
+            static constexpr size_t BLOCK_UNITS = 64;
+
+            const uint8_t* m_units;
+            size_t m_size;                  // in code units
+            size_t m_block;                 // the first code unit of the current block
+            uint64_t m_structurals;         // those of the current block that have not been returned
+            uint64_t m_next_is_escaped;     // 1 if the first code unit of the next block is escaped
+            uint64_t m_in_string;           // all ones if the next block starts inside a string
+
+            // the code units escaped by a backslash, see `json_escape_scanner` of simdjson
+            [[nodiscard]]
+            uint64_t find_escaped(uint64_t backslashes) noexcept {
+                constexpr uint64_t ODD_BITS = 0xaaaaaaaaaaaaaaaa;
+
+                if (backslashes == 0) {
+                    return std::exchange(m_next_is_escaped, 0);
+                }
+
+                auto potential_escapes = backslashes & ~m_next_is_escaped;
+                auto escapes_and_terminals = ((potential_escapes << 1 | ODD_BITS) - potential_escapes) ^ ODD_BITS;
+                auto escaped = escapes_and_terminals ^ (backslashes | m_next_is_escaped);
+                m_next_is_escaped = (escapes_and_terminals & backslashes) >> 63;
+                return escaped;
+            }
+
+            [[nodiscard]]
+            static uint64_t prefix_xor(uint64_t v) noexcept {
+                v ^= v << 1;
+                v ^= v << 2;
+                v ^= v << 4;
+                v ^= v << 8;
+                v ^= v << 16;
+                v ^= v << 32;
+                return v;
+            }
+
+            void load_block() noexcept {
+                JsonBlockMasks masks;
+                if (m_block + BLOCK_UNITS <= m_size) {
+                    masks = classify_json_block(m_units + 2 * m_block);
+                } else {
+                    // zeros are not structural
+                    std::array<uint8_t, 2 * BLOCK_UNITS> tail{};
+                    std::copy_n(m_units + 2 * m_block, 2 * (m_size - m_block), tail.begin());
+                    masks = classify_json_block(tail.data());
+                }
+
+                auto quotes = masks.quotes & ~find_escaped(masks.backslashes);
+                auto in_string = prefix_xor(quotes) ^ m_in_string;
+                m_in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+
+                m_structurals = (masks.operators & ~in_string) | (quotes & in_string);
+            }
+
+        public:
+            JsonStructuralIterator(const uint8_t* units, size_t size) noexcept
+                : m_units{ units }, m_size{ size }, m_block{}, m_structurals{}, m_next_is_escaped{}, m_in_string{}
+            {
+                if (0 < m_size) {
+                    load_block();
+                }
+            }
+
+            [[nodiscard]]
+            char16_t at(size_t pos) const noexcept {
+                return load_unit(m_units + 2 * pos);
+            }
+
+            // the position of the next structural character, or `npos` at the end
+            [[nodiscard]]
+            size_t next() noexcept {
+                while (m_structurals == 0) {
+                    if (m_size <= m_block + BLOCK_UNITS) {
+                        return npos;
+                    }
+                    m_block += BLOCK_UNITS;
+                    load_block();
+                }
+
+                auto retval = m_block + std::countr_zero(m_structurals);
+                m_structurals &= m_structurals - 1;
+                return retval;
+            }
+
+            // Skips the rest of the object or array that opens at `pos`, and returns where it closes.
+            [[nodiscard]]
+            size_t skip_container(size_t pos) noexcept {
+                size_t depth = 1;
+                while (true) {
+                    pos = next();
+                    if (pos == npos) {
+                        return npos;
+                    }
+
+                    auto c = at(pos);
+                    if (c == '{' || c == '[') {
+                        ++depth;
+                    } else if ((c == '}' || c == ']') && --depth == 0) {
+                        return pos;
+                    }
+                }
+            }
+        };
+
+        [[nodiscard]]
+        bool is_json_whitespace(char16_t c) noexcept {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        [[nodiscard]]
+        bool has_backslash(const uint8_t* units, size_t begin, size_t end) noexcept {
+            for (size_t i = begin; i < end; ++i) {
+                if (load_unit(units + 2 * i) == '\\') {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // The code units of the string whose quotes are at `begin` and `end - 1`, with escapes resolved.
+        [[nodiscard]]
+        std::optional<std::u16string> unescape_json_string(const uint8_t* units, size_t begin, size_t end) {
+            std::u16string retval;
+            for (size_t i = begin + 1; i + 1 < end; ++i) {
+                auto c = load_unit(units + 2 * i);
+                if (c != '\\') {
+                    retval.push_back(c);
+                    continue;
+                }
+
+                if (end - 1 <= ++i) {
+                    return std::nullopt;
+                }
+
+                switch (load_unit(units + 2 * i)) {
+                    case '"': retval.push_back(u'"'); break;
+                    case '\\': retval.push_back(u'\\'); break;
+                    case '/': retval.push_back(u'/'); break;
+                    case 'b': retval.push_back(u'\b'); break;
+                    case 'f': retval.push_back(u'\f'); break;
+                    case 'n': retval.push_back(u'\n'); break;
+                    case 'r': retval.push_back(u'\r'); break;
+                    case 't': retval.push_back(u'\t'); break;
+                    case 'u': {
+                        if (end - 1 < i + 5) {
+                            return std::nullopt;
+                        }
+
+                        char16_t unit = 0;
+                        for (size_t j = 1; j <= 4; ++j) {
+                            auto h = load_unit(units + 2 * (i + j));
+                            if ('0' <= h && h <= '9') {
+                                unit = static_cast<char16_t>(unit << 4 | (h - '0'));
+                            } else if ('a' <= (h | 0x20) && (h | 0x20) <= 'f') {
+                                unit = static_cast<char16_t>(unit << 4 | ((h | 0x20) - 'a' + 10));
+                            } else {
+                                return std::nullopt;
+                            }
+                        }
+                        retval.push_back(unit);
+                        i += 4;
+                        break;
+                    }
+                    default:
+                        return std::nullopt;
+                }
+            }
+            return retval;
+        }
+    }
+
+    std::optional<std::span<const std::byte>> vmgs_payload_find(std::span<const std::byte> payload, std::span<const std::u16string> path) {
+        auto units = reinterpret_cast<const uint8_t*>(payload.data());
+        auto size = payload.size() / 2;
+
+        auto bad = []() {
+            return std::invalid_argument("Bad VMGS payload: Malformed JSON text.");
+        };
+
+        auto skip_whitespace = [units, size](size_t pos) {
+            while (pos < size && is_json_whitespace(load_unit(units + 2 * pos))) {
+                ++pos;
+            }
+            return pos;
+        };
+
+        auto trim_whitespace = [units](size_t begin, size_t end) {
+            while (begin < end && is_json_whitespace(load_unit(units + 2 * (end - 1)))) {
+                --end;
+            }
+            return end;
+        };
+
+        JsonStructuralIterator iter{ units, size };
+
+        // the value being looked into opens at `pos`
+        auto pos = iter.next();
+        if (pos == JsonStructuralIterator::npos) {
+            throw bad();
+        }
+
+        auto value_begin = skip_whitespace(0);
+        while (value_begin < size && load_unit(units + 2 * value_begin) == 0) {
+            value_begin = skip_whitespace(value_begin + 1);
+        }
+
+        for (size_t step = 0; step <= path.size(); ++step) {
+            auto c = value_begin < size ? load_unit(units + 2 * value_begin) : char16_t{};
+
+            if (step == path.size()) {
+                // the value starts at `value_begin` and `pos` is its first structural character
+                size_t value_end;
+                if (c == '{' || c == '[') {
+                    value_end = iter.skip_container(pos);
+                    if (value_end == JsonStructuralIterator::npos) {
+                        throw bad();
+                    }
+                    ++value_end;
+                } else {
+                    auto next = c == '"' ? iter.next() : pos;
+                    value_end = trim_whitespace(value_begin, next == JsonStructuralIterator::npos ? size : next);
+                }
+
+                return payload.subspan(2 * value_begin, 2 * (value_end - value_begin));
+            }
+
+            if (c != '{' && c != '[') {
+                return std::nullopt;
+            }
+
+            // Advances past the member or element value that starts at `begin`, where `first` is the structural
+            // character that comes first at or after `begin`; returns the separator that follows it.
+            auto skip_value = [&](size_t begin, size_t first) {
+                auto v = begin < size ? load_unit(units + 2 * begin) : char16_t{};
+                if (first == begin && (v == '{' || v == '[')) {
+                    if (iter.skip_container(first) == JsonStructuralIterator::npos) {
+                        throw bad();
+                    }
+                    return iter.next();
+                } else if (first == begin && v == '"') {
+                    return iter.next();
+                } else {
+                    return first;
+                }
+            };
+
+            bool found = false;
+
+            if (c == '{') {
+                auto key = iter.next();
+                if (key != JsonStructuralIterator::npos && iter.at(key) == '}') {
+                    return std::nullopt;
+                }
+
+                while (!found) {
+                    auto colon = iter.next();
+                    if (key == JsonStructuralIterator::npos || colon == JsonStructuralIterator::npos || iter.at(key) != '"' || iter.at(colon) != ':') {
+                        throw bad();
+                    }
+
+                    auto key_end = trim_whitespace(key, colon);
+                    if (key_end - key < 2 || load_unit(units + 2 * (key_end - 1)) != '"') {
+                        throw bad();
+                    }
+
+                    auto begin = skip_whitespace(colon + 1);
+                    auto first = iter.next();
+                    if (first == JsonStructuralIterator::npos) {
+                        throw bad();
+                    }
+
+                    // most keys have no escapes, and are compared as they are
+                    const auto& name = path[step];
+                    auto raw_begin = key + 1;
+                    auto raw_end = key_end - 1;
+
+                    bool matched;
+                    if (!has_backslash(units, raw_begin, raw_end)) {
+                        matched = raw_end - raw_begin == name.size();
+                        for (size_t i = 0; matched && i < name.size(); ++i) {
+                            matched = load_unit(units + 2 * (raw_begin + i)) == name[i];
+                        }
+                    } else {
+                        auto unescaped = unescape_json_string(units, key, key_end);
+                        if (!unescaped.has_value()) {
+                            throw bad();
+                        }
+                        matched = unescaped.value() == name;
+                    }
+
+                    if (matched) {
+                        pos = first;
+                        value_begin = begin;
+                        found = true;
+                    } else {
+                        auto separator = skip_value(begin, first);
+                        if (separator == JsonStructuralIterator::npos) {
+                            throw bad();
+                        } else if (iter.at(separator) == '}') {
+                            return std::nullopt;
+                        } else if (iter.at(separator) != ',') {
+                            throw bad();
+                        }
+                        key = iter.next();
+                    }
+                }
+            } else {
+                size_t index = 0;
+                const auto& name = path[step];
+                if (name.empty() || 9 < name.size() || !std::ranges::all_of(name, [](char16_t v) { return u'0' <= v && v <= u'9'; })) {
+                    return std::nullopt;
+                }
+                for (auto v : name) {
+                    index = index * 10 + (v - u'0');
+                }
+
+                auto begin = skip_whitespace(value_begin + 1);
+                auto first = iter.next();
+                if (first == JsonStructuralIterator::npos) {
+                    throw bad();
+                } else if (first == begin && iter.at(first) == ']') {
+                    return std::nullopt;
+                }
+
+                for (size_t i = 0; !found; ++i) {
+                    if (i == index) {
+                        pos = first;
+                        value_begin = begin;
+                        found = true;
+                    } else {
+                        auto separator = skip_value(begin, first);
+                        if (separator == JsonStructuralIterator::npos) {
+                            throw bad();
+                        } else if (iter.at(separator) == ']') {
+                            return std::nullopt;
+                        } else if (iter.at(separator) != ',') {
+                            throw bad();
+                        }
+
+                        begin = skip_whitespace(separator + 1);
+                        first = iter.next();
+                        if (first == JsonStructuralIterator::npos) {
+                            throw bad();
+                        }
+                    }
+                }
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // Builds the Python objects of a JSON text the way `json.loads` does, except that the array of a `Data` member
+    // whose elements are all integers in [0, 256) becomes `bytes`, which is how NVRAM variables keep their values.
+    class VmgsJsonDecoder {
+    public:
+        static constexpr size_t MAX_DEPTH = 512;
+
+    private:
+        std::string_view m_text;
+        size_t m_pos;
+        std::unordered_map<std::string_view, py::object> m_keys;   // object keys without escapes, each decoded once
+        std::string m_scratch;
+
+        [[noreturn]]
+        void fail(std::string_view what) const {
+            throw py::value_error(std::format("Bad VMGS payload: {} at offset {:d} of the JSON text.", what, m_pos));
+        }
+
+        [[nodiscard]]
+        bool at_end() const noexcept {
+            return m_pos == m_text.size();
+        }
+
+        [[nodiscard]]
+        char peek() const noexcept {
+            return at_end() ? '\0' : m_text[m_pos];
+        }
+
+        void skip_whitespace() noexcept {
+            while (!at_end() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r')) {
+                ++m_pos;
+            }
+        }
+
+        [[nodiscard]]
+        bool consume(std::string_view token) noexcept {
+            if (m_text.substr(m_pos).starts_with(token)) {
+                m_pos += token.size();
+                return true;
+            } else {
+                return false;
+            }
+        }
+
+        void expect(char c) {
+            if (peek() != c) {
+                fail(std::format("Expecting '{}'", c));
+            }
+            ++m_pos;
+        }
+
+        static void append_utf8(std::string& s, char32_t cp) {
+            if (cp < 0x80) {
+                s.push_back(static_cast<char>(cp));
+            } else if (cp < 0x800) {
+                s.push_back(static_cast<char>(0xc0 | cp >> 6));
+                s.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            } else if (cp < 0x10000) {
+                s.push_back(static_cast<char>(0xe0 | cp >> 12));
+                s.push_back(static_cast<char>(0x80 | (cp >> 6 & 0x3f)));
+                s.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            } else {
+                s.push_back(static_cast<char>(0xf0 | cp >> 18));
+                s.push_back(static_cast<char>(0x80 | (cp >> 12 & 0x3f)));
+                s.push_back(static_cast<char>(0x80 | (cp >> 6 & 0x3f)));
+                s.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            }
+        }
+
+        [[nodiscard]]
+        char32_t parse_hex4() {
+            uint32_t retval = 0;
+            auto [ptr, ec] = std::from_chars(m_text.data() + m_pos, m_text.data() + std::min(m_pos + 4, m_text.size()), retval, 16);
+            if (ec != std::errc{} || ptr != m_text.data() + m_pos + 4) {
+                fail("Invalid \\uXXXX escape");
+            }
+            m_pos += 4;
+            return retval;
+        }
+
+        [[nodiscard]]
+        static py::object make_str(std::string_view s, const char* errors = nullptr) {
+            auto retval = py::reinterpret_steal<py::object>(PyUnicode_DecodeUTF8(s.data(), static_cast<py::ssize_t>(s.size()), errors));
+            if (!retval) {
+                throw py::error_already_set();
+            }
+            return retval;
+        }
+
+        // Returns the string and, if it has no escapes, its text.
+        [[nodiscard]]
+        std::pair<py::object, std::optional<std::string_view>> parse_string(bool is_key) {
+            expect('"');
+
+            auto begin = m_pos;
+            while (!at_end() && m_text[m_pos] != '"' && m_text[m_pos] != '\\' && 0x20 <= static_cast<unsigned char>(m_text[m_pos])) {
+                ++m_pos;
+            }
+
+            if (peek() == '"') {
+                auto s = m_text.substr(begin, m_pos - begin);
+                ++m_pos;
+
+                if (is_key) {
+                    auto iter = m_keys.find(s);
+                    if (iter == m_keys.end()) {
+                        iter = m_keys.emplace(s, make_str(s)).first;
+                    }
+                    return { iter->second, s };
+                } else {
+                    return { make_str(s), s };
+                }
+            }
+
+            m_scratch.assign(m_text.substr(begin, m_pos - begin));
+            while (true) {
+                if (at_end()) {
+                    fail("Unterminated string");
+                }
+
+                auto c = m_text[m_pos++];
+                if (c == '"') {
+                    break;
+                } else if (static_cast<unsigned char>(c) < 0x20) {
+                    --m_pos;
+                    fail("Invalid control character");
+                } else if (c != '\\') {
+                    m_scratch.push_back(c);
+                    continue;
+                }
+
+                switch (at_end() ? '\0' : m_text[m_pos++]) {
+                    case '"': m_scratch.push_back('"'); break;
+                    case '\\': m_scratch.push_back('\\'); break;
+                    case '/': m_scratch.push_back('/'); break;
+                    case 'b': m_scratch.push_back('\b'); break;
+                    case 'f': m_scratch.push_back('\f'); break;
+                    case 'n': m_scratch.push_back('\n'); break;
+                    case 'r': m_scratch.push_back('\r'); break;
+                    case 't': m_scratch.push_back('\t'); break;
+                    case 'u': {
+                        auto cp = parse_hex4();
+                        if (0xd800 <= cp && cp < 0xdc00 && m_text.substr(m_pos).starts_with("\\u")) {
+                            auto pos = m_pos;
+                            m_pos += 2;
+                            auto cp2 = parse_hex4();
+                            if (0xdc00 <= cp2 && cp2 < 0xe000) {
+                                cp = 0x10000 + ((cp - 0xd800) << 10 | (cp2 - 0xdc00));
+                            } else {
+                                m_pos = pos;
+                            }
+                        }
+                        // a lone surrogate is kept, as `json.loads` does
+                        append_utf8(m_scratch, cp);
+                        break;
+                    }
+                    default:
+                        --m_pos;
+                        fail("Invalid \\escape");
+                }
+            }
+
+            return { make_str(m_scratch, "surrogatepass"), std::nullopt };
+        }
+
+        [[nodiscard]]
+        py::object parse_number() {
+            auto begin = m_pos;
+
+            if (peek() == '-') {
+                ++m_pos;
+                if (consume("Infinity")) {
+                    return py::float_{ -std::numeric_limits<double>::infinity() };
+                }
+            }
+
+            auto is_digit = [this]() { return '0' <= peek() && peek() <= '9'; };
+
+            if (peek() == '0') {
+                ++m_pos;
+            } else if (is_digit()) {
+                while (is_digit()) {
+                    ++m_pos;
+                }
+            } else {
+                fail("Expecting value");
+            }
+
+            bool is_integer = true;
+
+            if (peek() == '.' && m_pos + 1 < m_text.size() && '0' <= m_text[m_pos + 1] && m_text[m_pos + 1] <= '9') {
+                is_integer = false;
+                ++m_pos;
+                while (is_digit()) {
+                    ++m_pos;
+                }
+            }
+
+            if (peek() == 'e' || peek() == 'E') {
+                auto pos = m_pos++;
+                if (peek() == '+' || peek() == '-') {
+                    ++m_pos;
+                }
+
+                if (is_digit()) {
+                    is_integer = false;
+                    while (is_digit()) {
+                        ++m_pos;
+                    }
+                } else {
+                    m_pos = pos;
+                }
+            }
+
+            auto s = m_text.substr(begin, m_pos - begin);
+            if (is_integer) {
+                long long v = 0;
+                auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+                if (ec == std::errc{}) {
+                    return py::reinterpret_steal<py::object>(PyLong_FromLongLong(v));
+                }
+
+                auto retval = py::reinterpret_steal<py::object>(PyLong_FromString(std::string{ s }.c_str(), nullptr, 10));
+                if (!retval) {
+                    throw py::error_already_set();
+                }
+                return retval;
+            } else {
+                double v = 0;
+                auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+                if (ec == std::errc::result_out_of_range) {
+                    // `float` rounds overflow to infinity and underflow to zero
+                    v = std::strtod(std::string{ s }.c_str(), nullptr);
+                }
+                return py::float_{ v };
+            }
+        }
+
+        // The array of a `Data` member as `bytes`, or nothing, with the position untouched, if it has other elements.
+        [[nodiscard]]
+        std::optional<py::bytes> parse_data() {
+            auto begin = m_pos;
+            m_scratch.clear();
+
+            expect('[');
+            skip_whitespace();
+            if (peek() == ']') {
+                ++m_pos;
+                return py::bytes{};
+            }
+
+            while (true) {
+                unsigned v = 0;
+                auto [ptr, ec] = std::from_chars(m_text.data() + m_pos, m_text.data() + m_text.size(), v);
+                auto n = ptr - (m_text.data() + m_pos);
+                if (ec != std::errc{} || 0xff < v || (1 < n && m_text[m_pos] == '0')) {
+                    m_pos = begin;
+                    return std::nullopt;
+                }
+                m_pos += n;
+                m_scratch.push_back(static_cast<char>(v));
+
+                skip_whitespace();
+                if (peek() == ',') {
+                    ++m_pos;
+                    skip_whitespace();
+                } else if (peek() == ']') {
+                    ++m_pos;
+                    return py::bytes{ m_scratch.data(), m_scratch.size() };
+                } else {
+                    m_pos = begin;
+                    return std::nullopt;
+                }
+            }
+        }
+
+        [[nodiscard]]
+        py::object parse_member_value(bool is_data, size_t depth) {
+            if (is_data && peek() == '[') {
+                if (auto data = parse_data()) {
+                    return std::move(data.value());
+                }
+            }
+            return parse_value(depth);
+        }
+
+        [[nodiscard]]
+        py::object parse_object(size_t depth) {
+            expect('{');
+
+            py::dict retval;
+
+            skip_whitespace();
+            if (peek() == '}') {
+                ++m_pos;
+                return retval;
+            }
+
+            while (true) {
+                if (peek() != '"') {
+                    fail("Expecting property name enclosed in double quotes");
+                }
+
+                auto [key, key_text] = parse_string(true);
+
+                skip_whitespace();
+                expect(':');
+                skip_whitespace();
+
+                retval[key] = parse_member_value(key_text == "Data", depth + 1);
+
+                skip_whitespace();
+                if (peek() == ',') {
+                    ++m_pos;
+                    skip_whitespace();
+                } else if (peek() == '}') {
+                    ++m_pos;
+                    return retval;
+                } else {
+                    fail("Expecting ',' delimiter");
+                }
+            }
+        }
+
+        [[nodiscard]]
+        py::object parse_array(size_t depth) {
+            expect('[');
+
+            py::list retval;
+
+            skip_whitespace();
+            if (peek() == ']') {
+                ++m_pos;
+                return retval;
+            }
+
+            while (true) {
+                retval.append(parse_value(depth + 1));
+
+                skip_whitespace();
+                if (peek() == ',') {
+                    ++m_pos;
+                    skip_whitespace();
+                } else if (peek() == ']') {
+                    ++m_pos;
+                    return retval;
+                } else {
+                    fail("Expecting ',' delimiter");
+                }
+            }
+        }
+
+        [[nodiscard]]
+        py::object parse_value(size_t depth) {
+            if (MAX_DEPTH < depth) {
+                fail("Too deeply nested");
+            }
+
+            switch (peek()) {
+                case '{':
+                    return parse_object(depth);
+                case '[':
+                    return parse_array(depth);
+                case '"':
+                    return parse_string(false).first;
+                default:
+                    break;
+            }
+
+            if (consume("true")) {
+                return py::bool_{ true };
+            } else if (consume("false")) {
+                return py::bool_{ false };
+            } else if (consume("null")) {
+                return py::none{};
+            } else if (consume("NaN")) {
+                return py::float_{ std::numeric_limits<double>::quiet_NaN() };
+            } else if (consume("Infinity")) {
+                return py::float_{ std::numeric_limits<double>::infinity() };
+            } else {
+                return parse_number();
+            }
+        }
+
+    public:
+        explicit VmgsJsonDecoder(std::string_view text) noexcept
+            : m_text{ text }, m_pos{}, m_keys{}, m_scratch{} {}
+
+        // `is_data` tells that the text is the value of a `Data` member.
+        [[nodiscard]]
+        py::object decode(bool is_data = false) {
+            skip_whitespace();
+            auto retval = parse_member_value(is_data, 0);
+            skip_whitespace();
+            if (!at_end()) {
+                fail("Extra data");
+            }
+            return retval;
+        }
+    };
+
+    std::optional<py::object> vmgs_payload_query(std::span<const std::byte> payload, std::span<const std::u16string> path) {
+        auto value = vmgs_payload_find(payload, path);
+        if (!value.has_value()) {
+            return std::nullopt;
+        }
+
+        auto text = vmgs_payload_to_utf8(value.value());
+        return VmgsJsonDecoder{ text }.decode(!path.empty() && path.back() == u"Data");
+    }
+
+    namespace {
+        // counts the characters of the JSON text, which is all ASCII
+        struct JsonSizeSink {
+            size_t size = 0;
+
+            void put(char) noexcept {
+                ++size;
+            }
+
+            void put(std::string_view s) noexcept {
+                size += s.size();
+            }
+        };
+
+        // writes the characters of the JSON text as UTF-16LE code units
+        struct JsonUtf16Sink {
+            std::byte* ptr;
+            std::byte* end;
+
+            void put(char c) {
+                if (ptr == end) {
+                    throw std::logic_error("Object changed while being encoded.");
+                }
+                ptr[0] = static_cast<std::byte>(c);
+                ptr[1] = std::byte{};
+                ptr += 2;
+            }
+
+            void put(std::string_view s) {
+                if (static_cast<size_t>(end - ptr) < s.size() * 2) {
+                    throw std::logic_error("Object changed while being encoded.");
+                }
+                for (auto c : s) {
+                    ptr[0] = static_cast<std::byte>(c);
+                    ptr[1] = std::byte{};
+                    ptr += 2;
+                }
+            }
+        };
+
+        // the decimal digits of a byte, followed by their count in the last char
+        constexpr auto BYTE_DECIMALS = [] {
+            std::array<std::array<char, 4>, 256> table{};
+            for (int i = 0; i < 256; ++i) {
+                int n = 0;
+                if (100 <= i) {
+                    table[i][n++] = static_cast<char>('0' + i / 100);
+                }
+                if (10 <= i) {
+                    table[i][n++] = static_cast<char>('0' + i / 10 % 10);
+                }
+                table[i][n++] = static_cast<char>('0' + i % 10);
+                table[i][3] = static_cast<char>(n);
+            }
+            return table;
+        }();
+
+        // Follows `json.dumps` with its default arguments: `ensure_ascii`, `", "` and `": "` as separators, and NaN
+        // and infinities allowed.
+        template<typename Sink>
+        class VmgsJsonEncoder {
+        public:
+            static constexpr size_t MAX_DEPTH = 512;
+
+        private:
+            Sink& m_sink;
+
+            void put_escape(uint32_t unit) {
+                constexpr std::string_view HEX_DIGITS = "0123456789abcdef";
+                char escape[] = { '\\', 'u', HEX_DIGITS[unit >> 12 & 0xf], HEX_DIGITS[unit >> 8 & 0xf], HEX_DIGITS[unit >> 4 & 0xf], HEX_DIGITS[unit & 0xf] };
+                m_sink.put(std::string_view{ escape, std::size(escape) });
+            }
+
+            void encode_string(PyObject* s) {
+                auto kind = PyUnicode_KIND(s);
+                auto data = PyUnicode_DATA(s);
+                auto length = PyUnicode_GET_LENGTH(s);
+
+                m_sink.put('"');
+                for (py::ssize_t i = 0; i < length; ++i) {
+                    auto c = PyUnicode_READ(kind, data, i);
+                    if (0x20 <= c && c < 0x7f && c != '"' && c != '\\') {
+                        m_sink.put(static_cast<char>(c));
+                    } else if (c == '"') {
+                        m_sink.put("\\\"");
+                    } else if (c == '\\') {
+                        m_sink.put("\\\\");
+                    } else if (c == '\n') {
+                        m_sink.put("\\n");
+                    } else if (c == '\r') {
+                        m_sink.put("\\r");
+                    } else if (c == '\t') {
+                        m_sink.put("\\t");
+                    } else if (c == '\b') {
+                        m_sink.put("\\b");
+                    } else if (c == '\f') {
+                        m_sink.put("\\f");
+                    } else if (c < 0x10000) {
+                        put_escape(c);
+                    } else {
+                        put_escape(0xd800 | (c - 0x10000) >> 10);
+                        put_escape(0xdc00 | (c & 0x3ff));
+                    }
+                }
+                m_sink.put('"');
+            }
+
+            void encode_integer(PyObject* v) {
+                int overflow = 0;
+                auto n = PyLong_AsLongLongAndOverflow(v, &overflow);
+                if (overflow == 0) {
+                    if (n == -1 && PyErr_Occurred()) {
+                        throw py::error_already_set();
+                    }
+
+                    char digits[24];
+                    auto [ptr, ec] = std::to_chars(std::begin(digits), std::end(digits), n);
+                    m_sink.put(std::string_view{ digits, ptr });
+                } else {
+                    // `int.__repr__`, as `json.dumps` uses for subclasses of `int` too
+                    auto repr = py::reinterpret_steal<py::object>(PyLong_Type.tp_repr(v));
+                    if (!repr) {
+                        throw py::error_already_set();
+                    }
+
+                    py::ssize_t size = 0;
+                    auto text = PyUnicode_AsUTF8AndSize(repr.ptr(), &size);
+                    if (text == nullptr) {
+                        throw py::error_already_set();
+                    }
+                    m_sink.put(std::string_view{ text, static_cast<size_t>(size) });
+                }
+            }
+
+            void encode_float(double v) {
+                if (std::isnan(v)) {
+                    m_sink.put("NaN");
+                } else if (std::isinf(v)) {
+                    m_sink.put(v < 0 ? "-Infinity" : "Infinity");
+                } else {
+                    // `float.__repr__`
+                    auto text = PyOS_double_to_string(v, 'r', 0, Py_DTSF_ADD_DOT_0, nullptr);
+                    if (text == nullptr) {
+                        throw py::error_already_set();
+                    }
+                    std::string_view text_{ text };
+                    try {
+                        m_sink.put(text_);
+                    } catch (...) {
+                        PyMem_Free(text);
+                        throw;
+                    }
+                    PyMem_Free(text);
+                }
+            }
+
+            void encode_bytes(PyObject* v) {
+                Py_buffer view;
+                if (PyObject_GetBuffer(v, &view, PyBUF_SIMPLE) != 0) {
+                    throw py::error_already_set();
+                }
+
+                auto release = std::unique_ptr<Py_buffer, decltype(&PyBuffer_Release)>{ &view, &PyBuffer_Release };
+                auto bytes = std::span{ static_cast<const uint8_t*>(view.buf), static_cast<size_t>(view.len) };
+
+                m_sink.put('[');
+                for (size_t i = 0; i < bytes.size(); ++i) {
+                    if (i != 0) {
+                        m_sink.put(", ");
+                    }
+                    auto& decimal = BYTE_DECIMALS[bytes[i]];
+                    m_sink.put(std::string_view{ decimal.data(), static_cast<size_t>(decimal[3]) });
+                }
+                m_sink.put(']');
+            }
+
+            void encode_key(PyObject* key) {
+                if (PyUnicode_Check(key)) {
+                    encode_string(key);
+                    return;
+                }
+
+                m_sink.put('"');
+                if (PyFloat_Check(key)) {
+                    encode_float(PyFloat_AS_DOUBLE(key));
+                } else if (key == Py_True) {
+                    m_sink.put("true");
+                } else if (key == Py_False) {
+                    m_sink.put("false");
+                } else if (key == Py_None) {
+                    m_sink.put("null");
+                } else if (PyLong_Check(key)) {
+                    encode_integer(key);
+                } else {
+                    throw py::type_error(std::format("keys must be str, int, float, bool or None, not {}", Py_TYPE(key)->tp_name));
+                }
+                m_sink.put('"');
+            }
+
+        public:
+            explicit VmgsJsonEncoder(Sink& sink) noexcept
+                : m_sink{ sink } {}
+
+            void encode(PyObject* v, size_t depth = 0) {
+                if (MAX_DEPTH < depth) {
+                    throw py::value_error("Object is too deeply nested, or has a circular reference.");
+                }
+
+                if (v == Py_None) {
+                    m_sink.put("null");
+                } else if (v == Py_True) {
+                    m_sink.put("true");
+                } else if (v == Py_False) {
+                    m_sink.put("false");
+                } else if (PyUnicode_Check(v)) {
+                    encode_string(v);
+                } else if (PyLong_Check(v)) {
+                    encode_integer(v);
+                } else if (PyFloat_Check(v)) {
+                    encode_float(PyFloat_AS_DOUBLE(v));
+                } else if (PyList_Check(v) || PyTuple_Check(v)) {
+                    auto items = py::reinterpret_steal<py::object>(PySequence_Fast(v, ""));
+                    if (!items) {
+                        throw py::error_already_set();
+                    }
+
+                    m_sink.put('[');
+                    for (py::ssize_t i = 0; i < PySequence_Fast_GET_SIZE(items.ptr()); ++i) {
+                        if (i != 0) {
+                            m_sink.put(", ");
+                        }
+                        encode(PySequence_Fast_GET_ITEM(items.ptr(), i), depth + 1);
+                    }
+                    m_sink.put(']');
+                } else if (PyDict_Check(v)) {
+                    m_sink.put('{');
+                    py::ssize_t pos = 0;
+                    PyObject* key;
+                    PyObject* value;
+                    for (bool first = true; PyDict_Next(v, &pos, &key, &value); first = false) {
+                        if (!first) {
+                            m_sink.put(", ");
+                        }
+                        encode_key(key);
+                        m_sink.put(": ");
+                        encode(value, depth + 1);
+                    }
+                    m_sink.put('}');
+                } else if (PyBytes_Check(v) || PyByteArray_Check(v) || PyMemoryView_Check(v)) {
+                    encode_bytes(v);
+                } else {
+                    throw py::type_error(std::format("Object of type {} is not JSON serializable", Py_TYPE(v)->tp_name));
+                }
+            }
+        };
+    }
+
+    size_t vmgs_encoded_size(py::handle obj) {
+        JsonSizeSink sink;
+        VmgsJsonEncoder{ sink }.encode(obj.ptr());
+        return sink.size * 2 + 2;
+    }
+
+    void vmgs_encode_to(py::handle obj, std::span<std::byte> buf) {
+        if (buf.size() < 2 || buf.size() % 2 != 0) {
+            throw std::invalid_argument("Bad VMGS payload buffer size.");
+        }
+
+        JsonUtf16Sink sink{ .ptr = buf.data(), .end = buf.data() + buf.size() - 2 };
+        VmgsJsonEncoder{ sink }.encode(obj.ptr());
+        if (sink.ptr != sink.end) {
+            throw std::logic_error("Object changed while being encoded.");
+        }
+
+        // the NUL terminator
+        sink.end[0] = std::byte{};
+        sink.end[1] = std::byte{};
+    }
+
+    struct vmgs_decode_tag;
+
+    template<>
+    struct function_pybinder_t<vmgs_decode_tag> : pybinder_t {
+        static constexpr std::string_view binder_identifier = "vmgs.vmgs_decode";
+
+        function_pybinder_t() {
+            auto [_, inserted] = pybinder_t::registered_binders().emplace(binder_identifier, this);
+            assert(inserted);
+        }
+
+        virtual void declare(py::module_&) override {}
+
+        virtual void make_binding(py::module_& m) override {
+            m.def(
+                "vmgs_decode",
+                [](py::buffer data) -> py::object {
+                    if (py::isinstance<py::bytes>(data) || py::isinstance<py::bytearray>(data) || py::isinstance<py::memoryview>(data)) {
+                        auto data_info = data.request();
+                        assert(data_info.itemsize == 1);
+
+                        auto text = vmgs_payload_to_utf8(std::span{ static_cast<const std::byte*>(data_info.ptr), static_cast<size_t>(data_info.size) });
+                        return VmgsJsonDecoder{ text }.decode();
+                    } else {
+                        throw py::type_error("`data` argument is not a instance of bytes/bytearray/memoryview type.");
+                    }
+                },
+                py::arg("data")
+            );
+        }
+    };
+
+    namespace { function_pybinder_t<vmgs_decode_tag> vmgs_decode_binder_; }
+
+    struct vmgs_encode_tag;
+
+    template<>
+    struct function_pybinder_t<vmgs_encode_tag> : pybinder_t {
+        static constexpr std::string_view binder_identifier = "vmgs.vmgs_encode";
+
+        function_pybinder_t() {
+            auto [_, inserted] = pybinder_t::registered_binders().emplace(binder_identifier, this);
+            assert(inserted);
+        }
+
+        virtual void declare(py::module_&) override {}
+
+        virtual void make_binding(py::module_& m) override {
+            m.def(
+                "vmgs_encode",
+                [](py::object data) -> py::bytes {
+                    auto size = vmgs_encoded_size(data);
+
+                    auto retval = py::reinterpret_steal<py::bytes>(PyBytes_FromStringAndSize(nullptr, static_cast<py::ssize_t>(size)));
+                    if (!retval) {
+                        throw py::error_already_set();
+                    }
+
+                    vmgs_encode_to(data, std::span{ reinterpret_cast<std::byte*>(PyBytes_AS_STRING(retval.ptr())), size });
+                    return retval;
+                },
+                py::arg("data")
+            );
+        }
+    };
+
+    namespace { function_pybinder_t<vmgs_encode_tag> vmgs_encode_binder_; }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+
+#include "py.hpp"
+
+namespace vmgs {
+    // The VMGS payload is a JSON text in UTF-16LE, terminated by NUL code units.
+    //
+    // Transcodes the payload to UTF-8, up to the first NUL code unit after any leading ones. Runs of ASCII, which is
+    // nearly all of a JSON text, are transcoded 8 code units at a time.
+    [[nodiscard]]
+    std::string vmgs_payload_to_utf8(std::span<const std::byte> payload);
+
+    // Finds the value at `path` in a VMGS payload while looking at little more than the structural characters of the
+    // JSON text before it, whose subtrees off the path are skipped whole. Each step of `path` is the name of an
+    // object member, or the decimal index of an array element.
+    //
+    // Returns the UTF-16LE text of the value, or nothing if there is none. The text is not validated beyond what
+    // the search needs.
+    [[nodiscard]]
+    std::optional<std::span<const std::byte>> vmgs_payload_find(std::span<const std::byte> payload, std::span<const std::u16string> path);
+
+    // `vmgs_payload_find`, with the value decoded as `vmgs_decode` would.
+    [[nodiscard]]
+    std::optional<py::object> vmgs_payload_query(std::span<const std::byte> payload, std::span<const std::u16string> path);
+
+    // Encodes `obj` as a VMGS payload, byte for byte as `json.dumps(obj).encode('utf-16-le') + b'\x00\x00'` does,
+    // except that bytes-like objects become arrays of integers.
+    //
+    // The encoder walks `obj` twice: once to size the payload exactly, and once to write the UTF-16LE code units
+    // straight into the destination, which can then be handed to the device as it is.
+    [[nodiscard]]
+    size_t vmgs_encoded_size(py::handle obj);
+
+    // `buf` must be `vmgs_encoded_size(obj)` bytes long.
+    void vmgs_encode_to(py::handle obj, std::span<std::byte> buf);
+}
@@ -113,6 +113,12 @@ namespace vmgs {
         }
     }
 
+    void Win32BlockDevice::flush() {
+        if (!FlushFileBuffers(m_handle)) {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+    }
+
     void Win32BlockDevice::close() {
         if (m_handle != INVALID_HANDLE_VALUE) {
             if (!CloseHandle(m_handle)) {
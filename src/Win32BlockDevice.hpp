@@ -61,6 +61,8 @@ namespace vmgs {
 
         virtual void write_blocks(uint64_t lba, uint32_t n, const void* buf) override;
 
+        virtual void flush() override;
+
         void close();
 
         [[nodiscard]]
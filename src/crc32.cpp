@@ -1,31 +1,391 @@
 #include "crc32.hpp"
 
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VMGS_CRC32_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define VMGS_CRC32_ARMV8 1
 #if defined(WIN32)
 #include <windows.h>
+#include <intrin.h>
+#else
+#include <arm_acle.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+#endif
 
-// available on Windows XP and above, implemented in ntdll.dll
-extern "C" NTSYSAPI
-DWORD NTAPI RtlComputeCrc32(_In_ DWORD Initial, _In_reads_bytes_(BufferSize) LPCVOID Buffer, _In_ ULONG BufferSize);
+// lets a function use instructions the rest of the build may not assume; MSVC allows any intrinsic anywhere
+#if defined(_MSC_VER) && !defined(__clang__)
+#define VMGS_TARGET(features)
+#else
+#define VMGS_TARGET(features) __attribute__((target(features)))
+#endif
 
 namespace vmgs {
-    uint32_t crc32_iso3309(uint32_t initial, const void* data, size_t size) noexcept {
-        while (0 < size) {
-            auto l = static_cast<ULONG>(std::min<size_t>(size, std::numeric_limits<ULONG>::max()));
+    namespace {
+        // Kernels take and return the CRC register, i.e. the one's complement of the CRC value.
+        using crc32_kernel_t = uint32_t (*)(uint32_t crc, const uint8_t* p, size_t size) noexcept;
+
+        // reflected polynomials
+        constexpr uint32_t CRC32_ISO3309_POLYNOMIAL = 0xedb88320;
+        constexpr uint32_t CRC32C_POLYNOMIAL = 0x82f63b78;
+
+        template<uint32_t Polynomial>
+        constexpr auto SLICING_TABLES = [] {
+            std::array<std::array<uint32_t, 256>, 8> tables{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t v = i;
+                for (int j = 0; j < 8; ++j) {
+                    v = (v >> 1) ^ (v & 1 ? Polynomial : 0);
+                }
+                tables[0][i] = v;
+            }
 
-            initial = RtlComputeCrc32(initial, data, l);
+            // tables[k][i] is the CRC register after byte `i` is followed by `k` zero bytes
+            for (size_t k = 1; k < tables.size(); ++k) {
+                for (uint32_t i = 0; i < 256; ++i) {
+                    tables[k][i] = (tables[k - 1][i] >> 8) ^ tables[0][tables[k - 1][i] & 0xff];
+                }
+            }
+            return tables;
+        }();
 
-            data = reinterpret_cast<const char*>(data) + l;
-            size = size - l;
+        // slicing-by-8, eight table lookups per 8 bytes
+        template<uint32_t Polynomial>
+        [[nodiscard]]
+        uint32_t crc32_slicing(uint32_t crc, const uint8_t* p, size_t size) noexcept {
+            const auto& t = SLICING_TABLES<Polynomial>;
+
+            for (; 8 <= size; p += 8, size -= 8) {
+                uint32_t lo = crc ^ (uint32_t{ p[0] } | uint32_t{ p[1] } << 8 | uint32_t{ p[2] } << 16 | uint32_t{ p[3] } << 24);
+                uint32_t hi = uint32_t{ p[4] } | uint32_t{ p[5] } << 8 | uint32_t{ p[6] } << 16 | uint32_t{ p[7] } << 24;
+                crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+                      t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+            }
+
+            for (; 0 < size; ++p, --size) {
+                crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+            }
+
+            return crc;
         }
-        return initial;
-    }
-}
+
+        uint32_t crc32_iso3309_slicing(uint32_t crc, const uint8_t* p, size_t size) noexcept {
+            return crc32_slicing<CRC32_ISO3309_POLYNOMIAL>(crc, p, size);
+        }
+
+        // `a * b mod P` over GF(2), where bit 31 is `x^0` as in the reflected CRC register
+        template<uint32_t Polynomial>
+        [[nodiscard]]
+        constexpr uint32_t multiply_mod(uint32_t a, uint32_t b) noexcept {
+            uint32_t retval = 0;
+            for (uint32_t m = uint32_t{ 1 } << 31; m != 0; m >>= 1) {
+                if (a & m) {
+                    retval ^= b;
+                }
+                b = b & 1 ? (b >> 1) ^ Polynomial : b >> 1;
+            }
+            return retval;
+        }
+
+        // X2N_TABLES<P>[k] is `x^(2^k) mod P`, for k up to 3 more than the bits of a byte count
+        template<uint32_t Polynomial>
+        constexpr auto X2N_TABLES = [] {
+            std::array<uint32_t, 64 + 3> table{};
+            uint32_t v = uint32_t{ 1 } << 30;
+            for (auto& t : table) {
+                t = v;
+                v = multiply_mod<Polynomial>(v, v);
+            }
+            return table;
+        }();
+
+        // `x^(8 * size) mod P`, i.e. what the CRC register is multiplied by when `size` zero bytes go through it
+        template<uint32_t Polynomial>
+        [[nodiscard]]
+        uint32_t x8n_mod(uint64_t size) noexcept {
+            uint32_t retval = uint32_t{ 1 } << 31;
+            for (size_t k = 3; size != 0; size >>= 1, ++k) {
+                if (size & 1) {
+                    retval = multiply_mod<Polynomial>(X2N_TABLES<Polynomial>[k], retval);
+                }
+            }
+            return retval;
+        }
+
+        // The pre- and post-conditioning of the two CRCs cancel out, see `crc32_combine` of zlib.
+        template<uint32_t Polynomial>
+        [[nodiscard]]
+        uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t size2) noexcept {
+            return multiply_mod<Polynomial>(x8n_mod<Polynomial>(size2), crc1) ^ crc2;
+        }
+
+        template<uint32_t Polynomial>
+        [[nodiscard]]
+        uint32_t crc32_zeros(uint32_t initial, uint64_t size) noexcept {
+            return ~multiply_mod<Polynomial>(x8n_mod<Polynomial>(size), ~initial);
+        }
+
+#if defined(VMGS_CRC32_X86)
+        // Folding with carry-less multiplication, see `Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+        // Instruction` by Intel. For the reflected polynomial, a 128-bit lane is folded over `n` bits with the
+        // constants `x^(n+32) mod P` (for the low half) and `x^(n-32) mod P` (for the high half), bit-reflected and
+        // shifted left by one.
+        alignas(16) constexpr uint64_t FOLD_BY_512[2] = { 0x154442bd4, 0x1c6e41596 };
+        alignas(16) constexpr uint64_t FOLD_BY_128[2] = { 0x1751997d0, 0x0ccaa009e };
+        alignas(16) constexpr uint64_t FOLD_BY_64[2] = { 0x163cd6124, 0 };
+        alignas(16) constexpr uint64_t BARRETT[2] = { 0x1db710641, 0x1f7011641 };    // P and floor(x^64 / P)
+
+        // for 512-bit registers
+        alignas(16) constexpr uint64_t FOLD_BY_2048[2] = { 0x11542778a, 0x1322d1430 };
+        alignas(16) constexpr uint64_t FOLD_BY_384[2] = { 0x03db1ecdc, 0x174359406 };
+        alignas(16) constexpr uint64_t FOLD_BY_256[2] = { 0x0f1da05aa, 0x15a546366 };
+
+        VMGS_TARGET("pclmul,sse4.1")
+        [[nodiscard]]
+        inline __m128i fold_lane(__m128i x, __m128i k, __m128i next) noexcept {
+            return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), next);
+        }
+
+        // folds the 16-byte blocks of `p` into `x`, then reduces `x` to the CRC register
+        VMGS_TARGET("pclmul,sse4.1")
+        [[nodiscard]]
+        uint32_t fold_finish(__m128i x, const uint8_t* p, size_t size) noexcept {
+            auto k = _mm_load_si128(reinterpret_cast<const __m128i*>(FOLD_BY_128));
+            for (; 16 <= size; p += 16, size -= 16) {
+                x = fold_lane(x, k, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+            }
+
+            // 128 bits to 64 bits
+            auto mask = _mm_setr_epi32(~0, 0, ~0, 0);
+            x = _mm_xor_si128(_mm_srli_si128(x, 8), _mm_clmulepi64_si128(x, k, 0x10));
+
+            k = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(FOLD_BY_64));
+            x = _mm_xor_si128(_mm_srli_si128(x, 4), _mm_clmulepi64_si128(_mm_and_si128(x, mask), k, 0x00));
+
+            // Barrett reduction to 32 bits
+            k = _mm_load_si128(reinterpret_cast<const __m128i*>(BARRETT));
+            auto t = _mm_clmulepi64_si128(_mm_and_si128(x, mask), k, 0x10);
+            t = _mm_clmulepi64_si128(_mm_and_si128(t, mask), k, 0x00);
+            x = _mm_xor_si128(x, t);
+
+            return static_cast<uint32_t>(_mm_extract_epi32(x, 1));
+        }
+
+        // `size` is at least 64 and a multiple of 16
+        VMGS_TARGET("pclmul,sse4.1")
+        [[nodiscard]]
+        uint32_t fold_pclmul(uint32_t crc, const uint8_t* p, size_t size) noexcept {
+            auto x1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), _mm_cvtsi32_si128(static_cast<int>(crc)));
+            auto x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+            auto x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+            auto x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48));
+            p += 64;
+            size -= 64;
+
+            auto k = _mm_load_si128(reinterpret_cast<const __m128i*>(FOLD_BY_512));
+            for (; 64 <= size; p += 64, size -= 64) {
+                x1 = fold_lane(x1, k, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+                x2 = fold_lane(x2, k, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)));
+                x3 = fold_lane(x3, k, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)));
+                x4 = fold_lane(x4, k, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)));
+            }
+
+            k = _mm_load_si128(reinterpret_cast<const __m128i*>(FOLD_BY_128));
+            x1 = fold_lane(x1, k, x2);
+            x1 = fold_lane(x1, k, x3);
+            x1 = fold_lane(x1, k, x4);
+
+            return fold_finish(x1, p, size);
+        }
+
+        VMGS_TARGET("avx512f")
+        [[nodiscard]]
+        inline __m512i broadcast_lanes(const uint64_t (&k)[2]) noexcept {
+            auto lo = static_cast<long long>(k[0]);
+            auto hi = static_cast<long long>(k[1]);
+            return _mm512_set4_epi64(hi, lo, hi, lo);
+        }
+
+        VMGS_TARGET("avx512f,vpclmulqdq")
+        [[nodiscard]]
+        inline __m512i fold_lanes(__m512i x, __m512i k, __m512i next) noexcept {
+            return _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(x, k, 0x00), _mm512_clmulepi64_epi128(x, k, 0x11), next, 0x96);
+        }
+
+        // `size` is at least 256 and a multiple of 16
+        VMGS_TARGET("avx512f,avx512vl,vpclmulqdq,pclmul,sse4.1")
+        [[nodiscard]]
+        uint32_t fold_vpclmul(uint32_t crc, const uint8_t* p, size_t size) noexcept {
+            auto x1 = _mm512_xor_si512(_mm512_loadu_si512(p), _mm512_zextsi128_si512(_mm_cvtsi32_si128(static_cast<int>(crc))));
+            auto x2 = _mm512_loadu_si512(p + 64);
+            auto x3 = _mm512_loadu_si512(p + 128);
+            auto x4 = _mm512_loadu_si512(p + 192);
+            p += 256;
+            size -= 256;
+
+            auto k = broadcast_lanes(FOLD_BY_2048);
+            for (; 256 <= size; p += 256, size -= 256) {
+                x1 = fold_lanes(x1, k, _mm512_loadu_si512(p));
+                x2 = fold_lanes(x2, k, _mm512_loadu_si512(p + 64));
+                x3 = fold_lanes(x3, k, _mm512_loadu_si512(p + 128));
+                x4 = fold_lanes(x4, k, _mm512_loadu_si512(p + 192));
+            }
+
+            k = broadcast_lanes(FOLD_BY_512);
+            x1 = fold_lanes(x1, k, x2);
+            x1 = fold_lanes(x1, k, x3);
+            x1 = fold_lanes(x1, k, x4);
+            for (; 64 <= size; p += 64, size -= 64) {
+                x1 = fold_lanes(x1, k, _mm512_loadu_si512(p));
+            }
+
+            // the four lanes of `x1` into the last one
+            auto x = _mm512_extracti32x4_epi32(x1, 3);
+            x = fold_lane(_mm512_extracti32x4_epi32(x1, 2), _mm_load_si128(reinterpret_cast<const __m128i*>(FOLD_BY_128)), x);
+            x = fold_lane(_mm512_extracti32x4_epi32(x1, 1), _mm_load_si128(reinterpret_cast<const __m128i*>(FOLD_BY_256)), x);
+            x = fold_lane(_mm512_extracti32x4_epi32(x1, 0), _mm_load_si128(reinterpret_cast<const __m128i*>(FOLD_BY_384)), x);
+
+            return fold_finish(x, p, size);
+        }
+
+        uint32_t crc32_iso3309_pclmul(uint32_t crc, const uint8_t* p, size_t size) noexcept {
+            if (64 <= size) {
+                auto n = size & ~size_t{ 15 };
+                crc = fold_pclmul(crc, p, n);
+                p += n;
+                size -= n;
+            }
+            return crc32_iso3309_slicing(crc, p, size);
+        }
+
+        uint32_t crc32_iso3309_vpclmul(uint32_t crc, const uint8_t* p, size_t size) noexcept {
+            if (256 <= size) {
+                auto n = size & ~size_t{ 15 };
+                crc = fold_vpclmul(crc, p, n);
+                p += n;
+                size -= n;
+            }
+            return crc32_iso3309_pclmul(crc, p, size);
+        }
+
+        void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t (&regs)[4]) noexcept {
+#if defined(_MSC_VER)
+            int r[4];
+            __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+            std::ranges::copy(r, regs);
 #else
-#include <zlib.h>
+            __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        }
 
-namespace vmgs {
-    uint32_t crc32_iso3309(uint32_t initial, const void *data, size_t size) noexcept {
-        return crc32_z(initial, reinterpret_cast<const Bytef*>(data), size);
+        [[nodiscard]]
+        uint64_t xgetbv0() noexcept {
+#if defined(_MSC_VER)
+            return _xgetbv(0);
+#else
+            uint32_t eax, edx;
+            __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return uint64_t{ edx } << 32 | eax;
+#endif
+        }
+
+        [[nodiscard]]
+        crc32_kernel_t select_crc32_iso3309_kernel() noexcept {
+            uint32_t regs[4];
+
+            cpuid(0, 0, regs);
+            uint32_t max_leaf = regs[0];
+
+            cpuid(1, 0, regs);
+            bool pclmul = regs[2] & (1u << 1);
+            bool sse41 = regs[2] & (1u << 19);
+            bool osxsave = regs[2] & (1u << 27);
+            if (!pclmul || !sse41) {
+                return crc32_iso3309_slicing;
+            }
+
+            // the OS must save the opmask and all 512-bit registers
+            if (7 <= max_leaf && osxsave && (xgetbv0() & 0xe6) == 0xe6) {
+                cpuid(7, 0, regs);
+                bool avx512f = regs[1] & (1u << 16);
+                bool avx512vl = regs[1] & (1u << 31);
+                bool vpclmulqdq = regs[2] & (1u << 10);
+                if (avx512f && avx512vl && vpclmulqdq) {
+                    return crc32_iso3309_vpclmul;
+                }
+            }
+
+            return crc32_iso3309_pclmul;
+        }
+#elif defined(VMGS_CRC32_ARMV8)
+        // the CRC32 instructions of ARMv8, which are optional before ARMv8.1
+        VMGS_TARGET("+crc")
+        uint32_t crc32_iso3309_armv8(uint32_t crc, const uint8_t* p, size_t size) noexcept {
+            for (; 0 < size && reinterpret_cast<uintptr_t>(p) % 8 != 0; ++p, --size) {
+                crc = __crc32b(crc, *p);
+            }
+
+            for (; 8 <= size; p += 8, size -= 8) {
+                uint64_t v;
+                memcpy(&v, p, 8);
+                crc = __crc32d(crc, v);
+            }
+
+            for (; 0 < size; ++p, --size) {
+                crc = __crc32b(crc, *p);
+            }
+
+            return crc;
+        }
+
+        [[nodiscard]]
+        crc32_kernel_t select_crc32_iso3309_kernel() noexcept {
+#if defined(__ARM_FEATURE_CRC32) || defined(__APPLE__)
+            return crc32_iso3309_armv8;
+#elif defined(WIN32)
+            return IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE) ? crc32_iso3309_armv8 : crc32_iso3309_slicing;
+#elif defined(__linux__)
+            return (getauxval(AT_HWCAP) & HWCAP_CRC32) ? crc32_iso3309_armv8 : crc32_iso3309_slicing;
+#else
+            return crc32_iso3309_slicing;
+#endif
+        }
+#else
+        [[nodiscard]]
+        crc32_kernel_t select_crc32_iso3309_kernel() noexcept {
+            return crc32_iso3309_slicing;
+        }
+#endif
+
+        // picked once when the module is loaded
+        const crc32_kernel_t CRC32_ISO3309_KERNEL = select_crc32_iso3309_kernel();
+    }
+
+    uint32_t crc32_iso3309(uint32_t initial, const void* data, size_t size) noexcept {
+        return ~CRC32_ISO3309_KERNEL(~initial, reinterpret_cast<const uint8_t*>(data), size);
+    }
+
+    uint32_t crc32_iso3309_combine(uint32_t crc1, uint32_t crc2, uint64_t size2) noexcept {
+        return crc32_combine<CRC32_ISO3309_POLYNOMIAL>(crc1, crc2, size2);
+    }
+
+    uint32_t crc32_iso3309_zeros(uint32_t initial, uint64_t size) noexcept {
+        return crc32_zeros<CRC32_ISO3309_POLYNOMIAL>(initial, size);
+    }
+
+    uint32_t crc32c(uint32_t initial, const void* data, size_t size) noexcept {
+        return ~crc32_slicing<CRC32C_POLYNOMIAL>(~initial, reinterpret_cast<const uint8_t*>(data), size);
     }
 }
-#endif
@@ -20,4 +20,29 @@ namespace vmgs {
     uint32_t crc32_iso3309(uint32_t initial, std::span<Ty, Extent> data) noexcept {
         return crc32_iso3309(initial, data.data(), data.size_bytes());
     }
+
+    // The CRC of A followed by B, from the CRC of A, the CRC of B and the size of B, in O(log size2).
+    [[nodiscard]]
+    uint32_t crc32_iso3309_combine(uint32_t crc1, uint32_t crc2, uint64_t size2) noexcept;
+
+    // The CRC of the data that `initial` is the CRC of, followed by `size` zero bytes, in O(log size). Lets a header
+    // that stores its own checksum be checked without copying it to clear the checksum field.
+    [[nodiscard]]
+    uint32_t crc32_iso3309_zeros(uint32_t initial, uint64_t size) noexcept;
+
+    // CRC-32C (Castagnoli), as used by VHDX.
+    [[nodiscard]]
+    uint32_t crc32c(uint32_t initial, const void* data, size_t size) noexcept;
+
+    template<typename Ty, std::size_t Cnt>
+    [[nodiscard]]
+    uint32_t crc32c(uint32_t initial, const std::array<Ty, Cnt>& data) noexcept {
+        return crc32c(initial, data.data(), Cnt * sizeof(Ty));
+    }
+
+    template<typename Ty, std::size_t Extent>
+    [[nodiscard]]
+    uint32_t crc32c(uint32_t initial, std::span<Ty, Extent> data) noexcept {
+        return crc32c(initial, data.data(), data.size_bytes());
+    }
 }
@@ -1,3 +1,5 @@
+import typing
+
 class VmgsIO:
 
     def __init__(self, **kwargs):
@@ -9,8 +11,26 @@ class VmgsIO:
     def __exit__(self, exc_type, exc_val, exc_tb) -> bool:
         pass
 
-    def read(self) -> bytes:
+    def read(self, zero_copy: bool = False) -> typing.Union[bytes, memoryview]:
+        pass
+
+    def query(self, path: typing.Union[str, typing.Sequence[typing.Union[str, int]]]) -> typing.Any:
         pass
 
     def write(self, buf: bytes) -> None:
         pass
+
+    def write_json(self, data: typing.Dict[str, typing.Any]) -> None:
+        pass
+
+    def flush(self) -> None:
+        pass
+
+    def close(self) -> None:
+        pass
+
+def vmgs_decode(data: typing.Union[bytes, bytearray, memoryview]) -> typing.Dict[str, typing.Any]:
+    pass
+
+def vmgs_encode(data: typing.Dict[str, typing.Any]) -> bytes:
+    pass